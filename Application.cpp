@@ -50,8 +50,19 @@ Application::Application(char *infile) {
 	srand (time(NULL));
 	par->setparams(infile);
 	log = new Log(par);
-	en = new EmulNet(par);
-	en1 = new EmulNet(par);
+	if ( par->TRANSPORT == SOCKET_TRANSPORT ) {
+		// each network takes the ports of SOCKET_MAX_NODES nodes after its base
+		en = new SocketNet(par, SOCK_DGRAM, par->PORTNUM);
+		en1 = new SocketNet(par, SOCK_STREAM, par->PORTNUM + SOCKET_MAX_NODES + 1);
+	}
+	else if ( par->TRANSPORT == URING_TRANSPORT ) {
+		en = new UringNet(par, SOCK_DGRAM, par->PORTNUM);
+		en1 = new UringNet(par, SOCK_STREAM, par->PORTNUM + SOCKET_MAX_NODES + 1);
+	}
+	else {
+		en = new EmulNet(par);
+		en1 = new EmulNet(par);
+	}
 	mp1 = (MP1Node **) malloc(par->EN_GPSZ * sizeof(MP1Node *));
 	mp2 = (MP2Node **) malloc(par->EN_GPSZ * sizeof(MP2Node *));
 
@@ -324,6 +335,14 @@ void Application::mp2Run() {
 		} // End of update test
 
 	} // end of if ( par->getcurrtime == TEST_TIME)
+
+	/**
+	 * Send the messages the nodes batched during this tick, including those of
+	 * nodes failed by the tests after they queued them
+	 */
+	for ( i = 0; i <= par->EN_GPSZ-1; i++ ) {
+		mp2[i]->flushOutbound();
+	}
 }
 
 /**
@@ -13,6 +13,7 @@
 #include "Params.h"
 #include "Member.h"
 #include "EmulNet.h"
+#include "UringNet.h"
 #include "Queue.h"
 #include "MP2Node.h"
 #include "Node.h"
@@ -51,8 +52,9 @@ private:
 	// Address for introduction to the group
 	// Coordinator Node
 	char JOINADDR[30];
-	EmulNet *en;
-	EmulNet *en1;
+	// networks of the membership protocol and of the key value store
+	Network *en;
+	Network *en1;
     Log *log;
 	MP1Node **mp1;
 	MP2Node **mp2;
@@ -0,0 +1,134 @@
+/**********************************
+ * FILE NAME: BloomFilter.cpp
+ *
+ * DESCRIPTION: Definition of the bloom filter kept for each SSTable
+ **********************************/
+
+#include "BloomFilter.h"
+
+/**
+ * Constructor
+ */
+BloomFilter::BloomFilter(): numHashes(1) {
+	bits.assign(1, 0);
+}
+
+/**
+ * FUNCTION NAME: init
+ *
+ * DESCRIPTION: Sizes an empty filter for expectedKeys keys
+ */
+void BloomFilter::init(uint64_t expectedKeys) {
+	uint64_t numBits = expectedKeys * BLOOM_BITS_PER_KEY;
+	if ( numBits < 64 ) {
+		numBits = 64;
+	}
+	bits.assign((numBits + 63) / 64, 0);
+	// k = bits per key * ln 2 minimizes the false positive rate
+	numHashes = (uint32_t)(BLOOM_BITS_PER_KEY * 0.69);
+}
+
+/**
+ * FUNCTION NAME: hashOf
+ *
+ * DESCRIPTION: 64-bit FNV-1a hash of the key. The bits set are persisted with the
+ * 				SSTables, so the hash must not depend on the standard library.
+ */
+uint64_t BloomFilter::hashOf(string_view key) {
+	uint64_t h = 14695981039346656037ull;
+	for ( unsigned char c : key ) {
+		h = (h ^ c) * 1099511628211ull;
+	}
+	return h;
+}
+
+/**
+ * FUNCTION NAME: add
+ *
+ * DESCRIPTION: Sets the k bits of the key
+ */
+void BloomFilter::add(string_view key) {
+	uint64_t h = hashOf(key);
+	uint64_t delta = (h >> 33) | (h << 31);
+	uint64_t numBits = bits.size() * 64;
+	for ( uint32_t i = 0; i < numHashes; i++ ) {
+		uint64_t bit = h % numBits;
+		bits[bit / 64] |= (uint64_t)1 << (bit % 64);
+		h += delta;
+	}
+}
+
+/**
+ * FUNCTION NAME: mayContain
+ *
+ * RETURNS:
+ * false if the key was certainly never added
+ * true otherwise
+ */
+bool BloomFilter::mayContain(string_view key) {
+	uint64_t h = hashOf(key);
+	uint64_t delta = (h >> 33) | (h << 31);
+	uint64_t numBits = bits.size() * 64;
+	for ( uint32_t i = 0; i < numHashes; i++ ) {
+		uint64_t bit = h % numBits;
+		if ( !(bits[bit / 64] & ((uint64_t)1 << (bit % 64))) ) {
+			return false;
+		}
+		h += delta;
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: disable
+ *
+ * DESCRIPTION: Makes the filter answer maybe for every key, for bits that cannot be trusted
+ */
+void BloomFilter::disable() {
+	numHashes = 0;
+}
+
+/**
+ * FUNCTION NAME: serialize
+ *
+ * DESCRIPTION: Appends [u32 k][u32 number of words][words] to out
+ */
+void BloomFilter::serialize(string &out) {
+	uint32_t words = (uint32_t)bits.size();
+	out.append((char *)&numHashes, sizeof(numHashes));
+	out.append((char *)&words, sizeof(words));
+	out.append((char *)bits.data(), words * sizeof(uint64_t));
+}
+
+/**
+ * FUNCTION NAME: deserialize
+ *
+ * DESCRIPTION: Loads a filter written by serialize
+ *
+ * RETURNS:
+ * true on SUCCESS
+ * false if the bytes are not a valid filter
+ */
+bool BloomFilter::deserialize(const char *data, size_t size) {
+	uint32_t words;
+	if ( size < 2 * sizeof(uint32_t) ) {
+		return false;
+	}
+	memcpy(&numHashes, data, sizeof(numHashes));
+	memcpy(&words, data + sizeof(numHashes), sizeof(words));
+	if ( words == 0 || size < 2 * sizeof(uint32_t) + (size_t)words * sizeof(uint64_t) ) {
+		return false;
+	}
+	bits.resize(words);
+	memcpy(bits.data(), data + 2 * sizeof(uint32_t), words * sizeof(uint64_t));
+	return true;
+}
+
+/**
+ * FUNCTION NAME: memoryBytes
+ *
+ * DESCRIPTION: Returns the memory held by the bit array
+ */
+size_t BloomFilter::memoryBytes() {
+	return bits.size() * sizeof(uint64_t);
+}
@@ -0,0 +1,45 @@
+/**********************************
+ * FILE NAME: BloomFilter.h
+ *
+ * DESCRIPTION: Header file of the bloom filter kept for each SSTable
+ **********************************/
+
+#ifndef BLOOMFILTER_H_
+#define BLOOMFILTER_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+#include <string_view>
+
+/*
+ * Macros
+ */
+// about 1% false positives
+#define BLOOM_BITS_PER_KEY 10
+
+/**
+ * CLASS NAME: BloomFilter
+ *
+ * DESCRIPTION: Bit array answering "definitely absent" or "maybe present" for a key.
+ * 				The k probe positions come from one hash by double hashing.
+ */
+class BloomFilter {
+private:
+	vector<uint64_t> bits;
+	uint32_t numHashes;
+	static uint64_t hashOf(string_view key);
+public:
+	BloomFilter();
+	void init(uint64_t expectedKeys);
+	void add(string_view key);
+	bool mayContain(string_view key);
+	void disable();
+	void serialize(string &out);
+	bool deserialize(const char *data, size_t size);
+	size_t memoryBytes();
+};
+
+#endif /* BLOOMFILTER_H_ */
@@ -0,0 +1,201 @@
+/**********************************
+ * FILE NAME: Coding.h
+ *
+ * DESCRIPTION: Integer and byte string encoding shared by the on-disk and wire formats
+ **********************************/
+
+#ifndef CODING_H_
+#define CODING_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+#include <string_view>
+
+/**
+ * FUNCTION NAME: putU32
+ *
+ * DESCRIPTION: Appends a 32 bit integer in little-endian order
+ */
+inline void putU32(string &out, uint32_t v) {
+	char bytes[4] = { (char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24) };
+	out.append(bytes, 4);
+}
+
+/**
+ * FUNCTION NAME: putU64
+ *
+ * DESCRIPTION: Appends a 64 bit integer in little-endian order
+ */
+inline void putU64(string &out, uint64_t v) {
+	putU32(out, (uint32_t)v);
+	putU32(out, (uint32_t)(v >> 32));
+}
+
+/**
+ * FUNCTION NAME: getU32
+ *
+ * DESCRIPTION: Reads a little-endian 32 bit integer
+ */
+inline uint32_t getU32(const char *in) {
+	const unsigned char *b = (const unsigned char *)in;
+	return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/**
+ * FUNCTION NAME: getU64
+ *
+ * DESCRIPTION: Reads a little-endian 64 bit integer
+ */
+inline uint64_t getU64(const char *in) {
+	return (uint64_t)getU32(in) | ((uint64_t)getU32(in + 4) << 32);
+}
+
+/**
+ * FUNCTION NAME: putVarint64
+ *
+ * DESCRIPTION: Appends an integer 7 bits per byte, low bits first, the high bit of
+ * 				each byte but the last set: 1 byte below 128, at most 10
+ */
+inline void putVarint64(string &out, uint64_t v) {
+	while ( v >= 128 ) {
+		out.push_back((char)(v | 128));
+		v >>= 7;
+	}
+	out.push_back((char)v);
+}
+
+/**
+ * FUNCTION NAME: putVarint32
+ *
+ * DESCRIPTION: Appends a 32 bit integer as a varint, at most 5 bytes
+ */
+inline void putVarint32(string &out, uint32_t v) {
+	putVarint64(out, v);
+}
+
+/**
+ * FUNCTION NAME: encodeU32
+ *
+ * DESCRIPTION: Writes a 32 bit integer in little-endian order at dst and returns the byte after it
+ */
+inline char *encodeU32(char *dst, uint32_t v) {
+	dst[0] = (char)v;
+	dst[1] = (char)(v >> 8);
+	dst[2] = (char)(v >> 16);
+	dst[3] = (char)(v >> 24);
+	return dst + 4;
+}
+
+/**
+ * FUNCTION NAME: encodeVarint64
+ *
+ * DESCRIPTION: Writes the varint of v at dst, which must have room for varintLength(v)
+ * 				bytes, and returns the byte after it
+ */
+inline char *encodeVarint64(char *dst, uint64_t v) {
+	while ( v >= 128 ) {
+		*dst++ = (char)(v | 128);
+		v >>= 7;
+	}
+	*dst++ = (char)v;
+	return dst;
+}
+
+/**
+ * FUNCTION NAME: encodeLengthPrefixed
+ *
+ * DESCRIPTION: Writes [varint32 size][bytes] at dst and returns the byte after it
+ */
+inline char *encodeLengthPrefixed(char *dst, string_view bytes) {
+	dst = encodeVarint64(dst, (uint32_t)bytes.size());
+	memcpy(dst, bytes.data(), bytes.size());
+	return dst + bytes.size();
+}
+
+/**
+ * FUNCTION NAME: varintLength
+ *
+ * DESCRIPTION: Returns the number of bytes of the varint of v
+ */
+inline size_t varintLength(uint64_t v) {
+	size_t length = 1;
+	while ( v >= 128 ) {
+		v >>= 7;
+		length++;
+	}
+	return length;
+}
+
+/**
+ * FUNCTION NAME: getVarint64
+ *
+ * DESCRIPTION: Reads a varint from the bytes [p, limit) into *v
+ *
+ * RETURNS:
+ * the first byte after the varint
+ * NULL if the varint is truncated or longer than 10 bytes
+ */
+inline const char *getVarint64(const char *p, const char *limit, uint64_t *v) {
+	uint64_t result = 0;
+	for ( int shift = 0; shift <= 63 && p < limit; shift += 7 ) {
+		uint64_t byte = (unsigned char)*p++;
+		result |= (byte & 127) << shift;
+		if ( byte < 128 ) {
+			*v = result;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * FUNCTION NAME: getVarint32
+ *
+ * DESCRIPTION: Same for a 32 bit integer
+ *
+ * RETURNS:
+ * NULL also if the value does not fit 32 bits
+ */
+inline const char *getVarint32(const char *p, const char *limit, uint32_t *v) {
+	uint64_t result;
+	p = getVarint64(p, limit, &result);
+	if ( p == NULL || result > 0xFFFFFFFFull ) {
+		return NULL;
+	}
+	*v = (uint32_t)result;
+	return p;
+}
+
+/**
+ * FUNCTION NAME: putLengthPrefixed
+ *
+ * DESCRIPTION: Appends [varint32 size][bytes]
+ */
+inline void putLengthPrefixed(string &out, string_view bytes) {
+	putVarint32(out, (uint32_t)bytes.size());
+	out.append(bytes.data(), bytes.size());
+}
+
+/**
+ * FUNCTION NAME: getLengthPrefixed
+ *
+ * DESCRIPTION: Reads [varint32 size][bytes] from [p, limit); *bytes points into the input
+ *
+ * RETURNS:
+ * the first byte after the bytes
+ * NULL if truncated
+ */
+inline const char *getLengthPrefixed(const char *p, const char *limit, string_view *bytes) {
+	uint32_t size;
+	p = getVarint32(p, limit, &size);
+	if ( p == NULL || size > (size_t)(limit - p) ) {
+		return NULL;
+	}
+	*bytes = string_view(p, size);
+	return p + size;
+}
+
+#endif /* CODING_H_ */
@@ -0,0 +1,212 @@
+/**********************************
+ * FILE NAME: CommitLog.cpp
+ *
+ * DESCRIPTION: Definition of the replica write-ahead log
+ **********************************/
+
+#include "CommitLog.h"
+#include "Coding.h"
+
+// bytes before the body of a record: body length and checksum
+#define RECORD_HEADER 8
+// op and key length at the start of a body
+#define BODY_HEADER 5
+
+/**
+ * FUNCTION NAME: checksum
+ *
+ * DESCRIPTION: FNV-1a hash of a record body, used to detect torn or corrupt records
+ */
+static uint32_t checksum(const char *data, size_t size) {
+	uint32_t h = 2166136261u;
+	for ( size_t i = 0; i < size; i++ ) {
+		h = (h ^ (unsigned char)data[i]) * 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Constructor
+ */
+CommitLog::CommitLog(string path, syncPOLICY policy, int syncPeriod): path(path), fd(-1), policy(policy),
+		syncPeriod(syncPeriod), lastSync(0), unsynced(false), records(0) {}
+
+/**
+ * Destructor
+ */
+CommitLog::~CommitLog() {
+	if ( fd >= 0 ) {
+		commit(lastSync);
+		if ( unsynced && policy != SYNC_NONE ) {
+			fdatasync(fd);
+		}
+		close(fd);
+	}
+}
+
+/**
+ * FUNCTION NAME: replay
+ *
+ * DESCRIPTION: Reads the log from the start with large sequential reads and hands every
+ * 				record to apply. A torn or corrupt tail is cut off so that new records
+ * 				are appended after the last good one.
+ *
+ * RETURNS:
+ * number of records replayed
+ */
+int CommitLog::replay(const function<void(LogOp, const string &, const string &)> &apply) {
+	int in = ::open(path.c_str(), O_RDONLY);
+	if ( in < 0 ) {
+		// No log yet
+		return 0;
+	}
+
+	char *chunk = (char *)malloc(REPLAY_CHUNK);
+	string pending, key, value;
+	off_t goodBytes = 0;
+	int replayed = 0;
+	bool corrupt = false;
+	ssize_t n;
+
+	while ( !corrupt && (n = read(in, chunk, REPLAY_CHUNK)) > 0 ) {
+		pending.append(chunk, n);
+		size_t pos = 0;
+		while ( pending.size() - pos >= RECORD_HEADER ) {
+			uint32_t bodySize = getU32(pending.data() + pos);
+			if ( pending.size() - pos - RECORD_HEADER < bodySize ) {
+				// Record continues in the next chunk
+				break;
+			}
+			const char *body = pending.data() + pos + RECORD_HEADER;
+			if ( bodySize < BODY_HEADER || checksum(body, bodySize) != getU32(pending.data() + pos + 4)
+					|| getU32(body + 1) > bodySize - BODY_HEADER ) {
+				corrupt = true;
+				break;
+			}
+			uint32_t keySize = getU32(body + 1);
+			key.assign(body + BODY_HEADER, keySize);
+			value.assign(body + BODY_HEADER + keySize, bodySize - BODY_HEADER - keySize);
+			apply((LogOp)body[0], key, value);
+			replayed++;
+			pos += RECORD_HEADER + bodySize;
+		}
+		pending.erase(0, pos);
+		goodBytes += pos;
+	}
+	free(chunk);
+	close(in);
+
+	if ( corrupt || !pending.empty() ) {
+		::truncate(path.c_str(), goodBytes);
+	}
+	records += replayed;
+	return replayed;
+}
+
+/**
+ * FUNCTION NAME: open
+ *
+ * DESCRIPTION: Opens the log for appending, creating it if needed
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int CommitLog::open() {
+	fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+	return fd < 0 ? FAILURE : SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: append
+ *
+ * DESCRIPTION: Adds a record to the current batch. Nothing reaches the file before commit().
+ */
+void CommitLog::append(LogOp op, string_view key, string_view value) {
+	size_t start = batch.size();
+	putU32(batch, (uint32_t)(BODY_HEADER + key.size() + value.size()));
+	putU32(batch, 0);
+	batch.push_back((char)op);
+	putU32(batch, (uint32_t)key.size());
+	batch.append(key.data(), key.size());
+	batch.append(value.data(), value.size());
+
+	uint32_t sum = checksum(batch.data() + start + RECORD_HEADER, batch.size() - start - RECORD_HEADER);
+	string sumBytes;
+	putU32(sumBytes, sum);
+	batch.replace(start + 4, 4, sumBytes);
+	records++;
+}
+
+/**
+ * FUNCTION NAME: commit
+ *
+ * DESCRIPTION: Group commit: writes every record appended since the last call with a
+ * 				single write(), then syncs according to the policy:
+ * 				SYNC_BATCH every commit, SYNC_PERIODIC once every syncPeriod time units,
+ * 				SYNC_NONE never (left to the kernel).
+ * 				After a failure the batch keeps what is left to write, for the next call.
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int CommitLog::commit(int currtime) {
+	if ( fd < 0 ) {
+		return FAILURE;
+	}
+
+	size_t written = 0;
+	while ( written < batch.size() ) {
+		ssize_t n = write(fd, batch.data() + written, batch.size() - written);
+		if ( n < 0 ) {
+			// the bytes written stay in the file: the next commit carries on right after
+			// them, so the record cut short is completed rather than left torn
+			batch.erase(0, written);
+			return FAILURE;
+		}
+		written += n;
+	}
+	if ( written > 0 ) {
+		batch.clear();
+		unsynced = true;
+	}
+
+	if ( unsynced && (policy == SYNC_BATCH || (policy == SYNC_PERIODIC && currtime - lastSync >= syncPeriod)) ) {
+		if ( fdatasync(fd) != 0 ) {
+			return FAILURE;
+		}
+		lastSync = currtime;
+		unsynced = false;
+	}
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: truncate
+ *
+ * DESCRIPTION: Empties the log, including the batch not yet committed.
+ * 				Only call it once every logged mutation is durable elsewhere (a snapshot).
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int CommitLog::truncate() {
+	if ( fd < 0 ) {
+		return FAILURE;
+	}
+	batch.clear();
+	if ( ftruncate(fd, 0) != 0 || fdatasync(fd) != 0 ) {
+		return FAILURE;
+	}
+	unsynced = false;
+	records = 0;
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: getRecords
+ *
+ * DESCRIPTION: Returns the number of records replayed or appended
+ */
+unsigned long CommitLog::getRecords() {
+	return records;
+}
@@ -0,0 +1,58 @@
+/**********************************
+ * FILE NAME: CommitLog.h
+ *
+ * DESCRIPTION: Header file of the replica write-ahead log
+ **********************************/
+
+#ifndef COMMITLOG_H_
+#define COMMITLOG_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "Params.h"
+#include <stdint.h>
+#include <functional>
+#include <string_view>
+
+/*
+ * Macros
+ */
+// size of the sequential reads done by replay
+#define REPLAY_CHUNK (1 << 20)
+
+// mutation kinds stored in the log
+enum LogOp { LOG_CREATE = 1, LOG_UPDATE, LOG_DELETE };
+
+/**
+ * CLASS NAME: CommitLog
+ *
+ * DESCRIPTION: Append-only log of the mutations applied to a node's HashTable.
+ * 				append() only buffers; commit() writes the whole batch with one
+ * 				write() and, depending on the sync policy, one fdatasync().
+ * 				Record: [u32 body length][u32 checksum][u8 op][u32 key length][key][value]
+ */
+class CommitLog {
+private:
+	string path;
+	int fd;
+	syncPOLICY policy;
+	int syncPeriod;
+	int lastSync;
+	// bytes written since the last fdatasync
+	bool unsynced;
+	string batch;
+	unsigned long records;
+public:
+	CommitLog(string path, syncPOLICY policy, int syncPeriod);
+	int replay(const function<void(LogOp, const string &, const string &)> &apply);
+	int open();
+	void append(LogOp op, string_view key, string_view value);
+	int commit(int currtime);
+	int truncate();
+	unsigned long getRecords();
+	virtual ~CommitLog();
+};
+
+#endif /* COMMITLOG_H_ */
@@ -0,0 +1,152 @@
+/**********************************
+ * FILE NAME: Crc32c.cpp
+ *
+ * DESCRIPTION: Definition of the CRC32C checksum of network frames
+ **********************************/
+
+#include "Crc32c.h"
+#include "Coding.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+/**
+ * FUNCTION NAME: buildTables
+ *
+ * DESCRIPTION: tables[0] is the classic byte at a time table; tables[k][b] is the crc of
+ * 				byte b followed by k zero bytes, so that 8 bytes are folded with 8 lookups
+ */
+static const uint32_t (*buildTables())[256] {
+	static uint32_t tables[8][256];
+	for ( uint32_t b = 0; b < 256; b++ ) {
+		uint32_t crc = b;
+		for ( int bit = 0; bit < 8; bit++ ) {
+			crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+		}
+		tables[0][b] = crc;
+	}
+	for ( uint32_t b = 0; b < 256; b++ ) {
+		for ( int k = 1; k < 8; k++ ) {
+			tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+		}
+	}
+	return tables;
+}
+
+static const uint32_t (*tables)[256] = buildTables();
+
+/**
+ * FUNCTION NAME: portable
+ *
+ * DESCRIPTION: Slicing-by-8 over the raw (inverted) crc register
+ */
+uint32_t Crc32c::portable(uint32_t crc, const char *data, size_t size) {
+	const unsigned char *p = (const unsigned char *)data;
+	while ( size >= 8 ) {
+		uint32_t low = getU32((const char *)p) ^ crc;
+		uint32_t high = getU32((const char *)p + 4);
+		crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^ tables[4][low >> 24]
+			^ tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^ tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while ( size-- > 0 ) {
+		crc = (crc >> 8) ^ tables[0][(crc ^ *p++) & 0xFF];
+	}
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * FUNCTION NAME: hardware
+ *
+ * DESCRIPTION: Same on the SSE4.2 crc32 instruction. Only called once hasHardware said so,
+ * 				hence compiled for SSE4.2 without requiring it of the whole program.
+ */
+__attribute__((target("sse4.2")))
+uint32_t Crc32c::hardware(uint32_t crc, const char *data, size_t size) {
+	const char *p = data;
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	while ( size >= 8 ) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		p += 8;
+		size -= 8;
+	}
+	crc = (uint32_t)crc64;
+#endif
+	while ( size >= 4 ) {
+		uint32_t word;
+		memcpy(&word, p, 4);
+		crc = _mm_crc32_u32(crc, word);
+		p += 4;
+		size -= 4;
+	}
+	while ( size-- > 0 ) {
+		crc = _mm_crc32_u8(crc, (unsigned char)*p++);
+	}
+	return crc;
+}
+
+/**
+ * FUNCTION NAME: hasHardware
+ *
+ * DESCRIPTION: Returns true if the CPU has the SSE4.2 crc32 instruction
+ */
+bool Crc32c::hasHardware() {
+	static bool sse42 = __builtin_cpu_supports("sse4.2");
+	return sse42;
+}
+#else
+uint32_t Crc32c::hardware(uint32_t crc, const char *data, size_t size) {
+	return portable(crc, data, size);
+}
+
+bool Crc32c::hasHardware() {
+	return false;
+}
+#endif
+
+/**
+ * FUNCTION NAME: extend
+ *
+ * DESCRIPTION: Returns the crc of the bytes whose crc is crc followed by data, so that
+ * 				a buffer can be checksummed in pieces; the crc of nothing is 0
+ */
+uint32_t Crc32c::extend(uint32_t crc, const char *data, size_t size) {
+	crc = ~crc;
+	crc = hasHardware() ? hardware(crc, data, size) : portable(crc, data, size);
+	return ~crc;
+}
+
+/**
+ * FUNCTION NAME: extendPortable
+ *
+ * DESCRIPTION: extend on the slicing-by-8 path, whatever the CPU
+ */
+uint32_t Crc32c::extendPortable(uint32_t crc, const char *data, size_t size) {
+	return ~portable(~crc, data, size);
+}
+
+/**
+ * FUNCTION NAME: extendHardware
+ *
+ * DESCRIPTION: extend on the crc32 instruction; the CPU must have it
+ */
+uint32_t Crc32c::extendHardware(uint32_t crc, const char *data, size_t size) {
+	return ~hardware(~crc, data, size);
+}
+
+/**
+ * FUNCTION NAME: implementation
+ *
+ * DESCRIPTION: Returns the name of the code path extend uses on this CPU
+ */
+const char *Crc32c::implementation() {
+	return hasHardware() ? "sse4.2" : "slicing-by-8";
+}
@@ -0,0 +1,40 @@
+/**********************************
+ * FILE NAME: Crc32c.h
+ *
+ * DESCRIPTION: Header file of the CRC32C checksum of network frames
+ **********************************/
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+
+/**
+ * CLASS NAME: Crc32c
+ *
+ * DESCRIPTION: CRC-32C (Castagnoli polynomial, reflected, as in iSCSI and ext4).
+ * 				On x86 CPUs with SSE4.2 it runs on the crc32 instruction, 8 bytes at a
+ * 				time; elsewhere it falls back to table driven slicing-by-8. The choice is
+ * 				made once, at the first call. Both give the same values.
+ */
+class Crc32c {
+private:
+	static uint32_t portable(uint32_t crc, const char *data, size_t size);
+	static uint32_t hardware(uint32_t crc, const char *data, size_t size);
+public:
+	static uint32_t extend(uint32_t crc, const char *data, size_t size);
+	// extend on one code path, the hardware one only if hasHardware(); for Crc32cBench
+	static uint32_t extendPortable(uint32_t crc, const char *data, size_t size);
+	static uint32_t extendHardware(uint32_t crc, const char *data, size_t size);
+	static bool hasHardware();
+	static uint32_t value(const char *data, size_t size) {
+		return extend(0, data, size);
+	}
+	static const char *implementation();
+};
+
+#endif /* CRC32C_H_ */
@@ -0,0 +1,92 @@
+/**********************************
+ * FILE NAME: Crc32cBench.cpp
+ *
+ * DESCRIPTION: Cross-check and microbenchmark of the two code paths of Crc32c.
+ * 				Standalone program, built apart from the Application:
+ * 				g++ -std=c++17 -O2 -o Crc32cBench Crc32cBench.cpp Crc32c.cpp
+ **********************************/
+
+#include "Crc32c.h"
+#include <chrono>
+#include <random>
+
+// slices compared between the two paths
+#define CHECK_SLICES 20000
+// slices start within the first CHECK_MAX_OFFSET bytes, and are shorter than CHECK_MAX_SIZE
+#define CHECK_MAX_OFFSET 64
+#define CHECK_MAX_SIZE 3000
+// bytes checksummed per path and message size
+#define BENCH_BYTES (1ul << 30)
+
+/**
+ * FUNCTION NAME: crossCheck
+ *
+ * DESCRIPTION: Checks the standard check value, then that both paths agree on random
+ * 				slices at any offset and length, and that extending a checksum piecewise
+ * 				gives the checksum of the whole slice
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+static int crossCheck(const string &buffer, mt19937 &random) {
+	if ( Crc32c::value("123456789", 9) != 0xE3069283u ) {
+		printf("check value of \"123456789\" is %08x, not e3069283\n", Crc32c::value("123456789", 9));
+		return FAILURE;
+	}
+	for ( int i = 0; i < CHECK_SLICES; i++ ) {
+		const char *slice = buffer.data() + random() % CHECK_MAX_OFFSET;
+		size_t size = random() % CHECK_MAX_SIZE;
+		size_t cut = size > 0 ? random() % size : 0;
+		uint32_t expected = Crc32c::extendPortable(0, slice, size);
+		bool agree = !Crc32c::hasHardware() || Crc32c::extendHardware(0, slice, size) == expected;
+		if ( !agree || Crc32c::extend(Crc32c::value(slice, cut), slice + cut, size - cut) != expected ) {
+			printf("paths disagree on %zu bytes at offset %zu\n", size, (size_t)(slice - buffer.data()));
+			return FAILURE;
+		}
+	}
+	printf("%d slices: both paths agree\n", CHECK_SLICES);
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: benchmark
+ *
+ * DESCRIPTION: Prints the time per byte of one path on messages of size bytes. Each call
+ * 				extends the checksum of the previous one, so that calls cannot overlap.
+ */
+static void benchmark(const char *name, uint32_t (*path)(uint32_t, const char *, size_t), const string &buffer, size_t size) {
+	uint32_t crc = 0;
+	size_t total = 0;
+	auto start = chrono::steady_clock::now();
+	while ( total < BENCH_BYTES ) {
+		crc = path(crc, buffer.data(), size);
+		total += size;
+	}
+	double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	printf("%-13s %8zu B: %.3f ns/B, %.2f GB/s (%08x)\n", name, size, ns / total, total / ns, crc);
+}
+
+/**********************************
+ * FUNCTION NAME: main
+ *
+ * DESCRIPTION: Runs the cross-check, then the benchmark if it passed
+ **********************************/
+int main() {
+	mt19937 random(1);
+	string buffer(1 << 20, 0);
+	for ( auto &c : buffer ) {
+		c = (char)random();
+	}
+
+	printf("extend uses %s\n", Crc32c::implementation());
+	if ( crossCheck(buffer, random) != SUCCESS ) {
+		return 1;
+	}
+	for ( size_t size : { (size_t)64, (size_t)512, (size_t)4000, buffer.size() } ) {
+		benchmark("slicing-by-8", Crc32c::extendPortable, buffer, size);
+		if ( Crc32c::hasHardware() ) {
+			benchmark("sse4.2", Crc32c::extendHardware, buffer, size);
+		}
+	}
+	return 0;
+}
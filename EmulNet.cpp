@@ -5,6 +5,9 @@
  **********************************/
 
 #include "EmulNet.h"
+#include "Crc32c.h"
+#include "Coding.h"
+#include <sched.h>
 
 /**
  * Constructor
@@ -15,13 +18,14 @@ EmulNet::EmulNet(Params *p)
 	int i,j;
 	par = p;
 	emulnet.setNextId(1);
-	emulnet.settCurrBuffSize(0);
 	enInited=0;
 	for ( i = 0; i < MAX_NODES; i++ ) {
 		for ( j = 0; j < MAX_TIME; j++ ) {
 			sent_msgs[i][j] = 0;
 			recv_msgs[i][j] = 0;
 		}
+		corrupt_msgs[i] = 0;
+		overflow_msgs[i] = 0;
 	}
 	//trace.funcExit("EmulNet::EmulNet", SUCCESS);
 }
@@ -38,6 +42,8 @@ EmulNet::EmulNet(EmulNet &anotherEmulNet) {
 			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
 			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
 		}
+		this->corrupt_msgs[i] = anotherEmulNet.corrupt_msgs[i];
+		this->overflow_msgs[i] = anotherEmulNet.overflow_msgs[i];
 	}
 	this->emulnet = anotherEmulNet.emulnet;
 }
@@ -54,6 +60,8 @@ EmulNet& EmulNet::operator =(EmulNet &anotherEmulNet) {
 			this->sent_msgs[i][j] = anotherEmulNet.sent_msgs[i][j];
 			this->recv_msgs[i][j] = anotherEmulNet.recv_msgs[i][j];
 		}
+		this->corrupt_msgs[i] = anotherEmulNet.corrupt_msgs[i];
+		this->overflow_msgs[i] = anotherEmulNet.overflow_msgs[i];
 	}
 	this->emulnet = anotherEmulNet.emulnet;
 	return *this;
@@ -76,10 +84,45 @@ void *EmulNet::ENinit(Address *myaddr, short port) {
 	return myaddr;
 }
 
+/**
+ * FUNCTION NAME: ENmailbox
+ *
+ * DESCRIPTION: Returns the mailbox of node id, creating it if needed. Senders racing to
+ * 				create it each build one; the first to install its own wins and the others
+ * 				delete theirs.
+ */
+MpscRing<en_msg *> *EmulNet::ENmailbox(int id) {
+	MpscRing<en_msg *> *mailbox = emulnet.mailbox[id].load(memory_order_acquire);
+	if ( mailbox != NULL ) {
+		return mailbox;
+	}
+	MpscRing<en_msg *> *created = new MpscRing<en_msg *>(par->MAILBOX_SIZE);
+	if ( emulnet.mailbox[id].compare_exchange_strong(mailbox, created, memory_order_acq_rel) ) {
+		return created;
+	}
+	delete created;
+	return mailbox;
+}
+
+/**
+ * FUNCTION NAME: ENmaxPayload
+ *
+ * DESCRIPTION: Returns the size of the largest message ENsend accepts
+ */
+int EmulNet::ENmaxPayload() {
+	int trailer = par->NETWORK_CHECKSUM ? EN_CHECKSUM_SIZE : 0;
+	return par->MAX_MSG_SIZE - (int)sizeof(en_msg) - trailer - 1;
+}
+
 /**
  * FUNCTION NAME: ENsend
  *
- * DESCRIPTION: EmulNet send function
+ * DESCRIPTION: EmulNet send function. With NETWORK_CHECKSUM the message carries a
+ * 				CRC32C trailer, checked by ENrecv. With MSG_CORRUPT_PROB a bit of the
+ * 				message may be flipped on the way.
+ * 				Safe to call from any thread: the message is pushed into the mailbox of
+ * 				the receiver without a lock. If the mailbox is full the message is dropped,
+ * 				after retrying for a while with MAILBOX_OVERFLOW: SPIN.
  *
  * RETURNS:
  * size
@@ -88,25 +131,45 @@ int EmulNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
 	en_msg *em;
 	static char temp[2048];
 	int sendmsg = rand() % 100;
+	int trailer = par->NETWORK_CHECKSUM ? EN_CHECKSUM_SIZE : 0;
+
+	int src = *(int *)(myaddr->addr);
+	int dst = *(int *)(toaddr->addr);
+	int time = par->getcurrtime();
 
-	if( (emulnet.currbuffsize >= ENBUFFSIZE) || (size + (int)sizeof(en_msg) >= par->MAX_MSG_SIZE) || (par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100)) ) {
+	assert(src <= MAX_NODES);
+	assert(dst >= 0 && dst <= MAX_NODES);
+	assert(time < MAX_TIME);
+
+	if( (size > ENmaxPayload()) || (par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100)) ) {
 		return 0;
 	}
 
-	em = (en_msg *)malloc(sizeof(en_msg) + size);
-	em->size = size;
+	em = (en_msg *)malloc(sizeof(en_msg) + size + trailer);
+	em->size = size + trailer;
 
 	memcpy(&(em->from.addr), &(myaddr->addr), sizeof(em->from.addr));
 	memcpy(&(em->to.addr), &(toaddr->addr), sizeof(em->from.addr));
 	memcpy(em + 1, data, size);
+	if ( trailer ) {
+		encodeU32((char *)(em + 1) + size, Crc32c::value(data, size));
+	}
+	if ( par->MSG_CORRUPT_PROB > 0 && em->size > 0 && rand() % 10000 < (int) (par->MSG_CORRUPT_PROB * 10000) ) {
+		int bit = rand() % (em->size * 8);
+		((char *)(em + 1))[bit / 8] ^= (char)(1 << (bit % 8));
+	}
 
-	emulnet.buff[emulnet.currbuffsize++] = em;
-
-	int src = *(int *)(myaddr->addr);
-	int time = par->getcurrtime();
-
-	assert(src <= MAX_NODES);
-	assert(time < MAX_TIME);
+	MpscRing<en_msg *> *mailbox = ENmailbox(dst);
+	bool pushed = mailbox->push(em);
+	for ( int i = 0; !pushed && par->MAILBOX_OVERFLOW == OVERFLOW_SPIN && i < EN_SPIN_LIMIT; i++ ) {
+		sched_yield();
+		pushed = mailbox->push(em);
+	}
+	if ( !pushed ) {
+		overflow_msgs[src]++;
+		free(em);
+		return 0;
+	}
 
 	sent_msgs[src][time]++;
 
@@ -136,39 +199,49 @@ int EmulNet::ENsend(Address *myaddr, Address *toaddr, string data) {
 /**
  * FUNCTION NAME: ENrecv
  *
- * DESCRIPTION: EmulNet receive function
+ * DESCRIPTION: EmulNet receive function: empties the mailbox of this node into the queue,
+ * 				oldest message first. With NETWORK_CHECKSUM, messages whose CRC32C does
+ * 				not match are dropped and counted instead of being queued.
  *
  * RETURN:
  * 0
  */
 int EmulNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue){
 	// times is always assumed to be 1
-	int i;
 	char* tmp;
 	int sz;
 	en_msg *emsg;
 
-	for( i = emulnet.currbuffsize - 1; i >= 0; i-- ) {
-		emsg = emulnet.buff[i];
+	int dst = *(int *)(myaddr->addr);
+	int time = par->getcurrtime();
 
-		if ( 0 == strcmp(emsg->to.addr, myaddr->addr) ) {
+	assert(dst >= 0 && dst <= MAX_NODES);
+	assert(time < MAX_TIME);
+
+	MpscRing<en_msg *> *mailbox = emulnet.mailbox[dst].load(memory_order_acquire);
+	en_msg *batch[EN_RECV_BATCH];
+	size_t count;
+	while ( mailbox != NULL && (count = mailbox->drain(batch, EN_RECV_BATCH)) > 0 ) {
+		for ( size_t i = 0; i < count; i++ ) {
+			emsg = batch[i];
 			sz = emsg->size;
+
+			if ( par->NETWORK_CHECKSUM ) {
+				sz -= EN_CHECKSUM_SIZE;
+				if ( sz < 0 || Crc32c::value((char *)(emsg+1), sz) != getU32((char *)(emsg+1) + sz) ) {
+					corrupt_msgs[dst]++;
+					free(emsg);
+					continue;
+				}
+			}
+
 			tmp = (char *) malloc(sz * sizeof(char));
 			memcpy(tmp, (char *)(emsg+1), sz);
 
-			emulnet.buff[i] = emulnet.buff[emulnet.currbuffsize-1];
-			emulnet.currbuffsize--;
-
 			(*enq)(queue, (char *)tmp, sz);
 
 			free(emsg);
 
-			int dst = *(int *)(myaddr->addr);
-			int time = par->getcurrtime();
-
-			assert(dst <= MAX_NODES);
-			assert(time < MAX_TIME);
-
 			recv_msgs[dst][time]++;
 		}
 	}
@@ -188,8 +261,16 @@ int EmulNet::ENcleanup() {
 
 	FILE* file = fopen("msgcount.log", "w+");
 
-	while(emulnet.currbuffsize > 0) {
-		free(emulnet.buff[--emulnet.currbuffsize]);
+	for ( i = 0; i <= MAX_NODES; i++ ) {
+		MpscRing<en_msg *> *mailbox = emulnet.mailbox[i].exchange(NULL);
+		if ( mailbox == NULL ) {
+			continue;
+		}
+		en_msg *emsg;
+		while ( mailbox->drain(&emsg, 1) == 1 ) {
+			free(emsg);
+		}
+		delete mailbox;
 	}
 
 	for ( i = 1; i <= par->EN_GPSZ; i++ ) {
@@ -212,7 +293,14 @@ int EmulNet::ENcleanup() {
 			}
 		}
 		fprintf(file, "\n");
-		fprintf(file, "node %3d sent_total %6u  recv_total %6u\n\n", i, sent_total, recv_total);
+		fprintf(file, "node %3d sent_total %6u  recv_total %6u", i, sent_total, recv_total);
+		if ( par->NETWORK_CHECKSUM ) {
+			fprintf(file, "  corrupt_total %6u", corrupt_msgs[i]);
+		}
+		if ( overflow_msgs[i] > 0 ) {
+			fprintf(file, "  overflow_total %6u", overflow_msgs[i]);
+		}
+		fprintf(file, "\n\n");
 	}
 
 	fclose(file);
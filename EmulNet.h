@@ -9,11 +9,18 @@
 
 #define MAX_NODES 1000
 #define MAX_TIME 3600
-#define ENBUFFSIZE 30000
+// attempts of a sender to find room in a full mailbox with MAILBOX_OVERFLOW: SPIN
+#define EN_SPIN_LIMIT 65536
+// messages ENrecv takes out of the mailbox at a time
+#define EN_RECV_BATCH 64
+// bytes of the CRC32C trailer of a message when NETWORK_CHECKSUM is on
+#define EN_CHECKSUM_SIZE 4
 
 #include "stdincludes.h"
 #include "Params.h"
 #include "Member.h"
+#include "MpscRing.h"
+#include "Network.h"
 
 using namespace std;
 
@@ -31,40 +38,39 @@ typedef struct en_msg {
 
 /**
  * Class Name: EM
+ *
+ * DESCRIPTION: The messages in flight, in one mailbox per destination node id, oldest first.
+ * 				A mailbox is a lock-free ring of MAILBOX_SIZE messages, so that nodes on
+ * 				different threads can send to it at once. It is created by the first
+ * 				message to its node. Copies share the mailboxes, which ENcleanup frees.
  */
 class EM {
 public:
 	int nextid;
-	int currbuffsize;
 	int firsteltindex;
-	en_msg* buff[ENBUFFSIZE];
-	EM() {}
+	atomic<MpscRing<en_msg *> *> mailbox[MAX_NODES + 1];
+	EM() {
+		for ( int i = 0; i <= MAX_NODES; i++ ) {
+			mailbox[i].store(NULL);
+		}
+	}
 	EM& operator = (EM &anotherEM) {
 		this->nextid = anotherEM.getNextId();
-		this->currbuffsize = anotherEM.getCurrBuffSize();
 		this->firsteltindex = anotherEM.getFirstEltIndex();
-		int i = this->currbuffsize;
-		while (i > 0) {
-			this->buff[i] = anotherEM.buff[i];
-			i--;
+		for ( int i = 0; i <= MAX_NODES; i++ ) {
+			this->mailbox[i].store(anotherEM.mailbox[i].load());
 		}
 		return *this;
 	}
 	int getNextId() {
 		return nextid;
 	}
-	int getCurrBuffSize() {
-		return currbuffsize;
-	}
 	int getFirstEltIndex() {
 		return firsteltindex;
 	}
 	void setNextId(int nextid) {
 		this->nextid = nextid;
 	}
-	void settCurrBuffSize(int currbuffsize) {
-		this->currbuffsize = currbuffsize;
-	}
 	void setFirstEltIndex(int firsteltindex) {
 		this->firsteltindex = firsteltindex;
 	}
@@ -76,12 +82,16 @@ public:
  *
  * DESCRIPTION: This class defines an emulated network
  */
-class EmulNet
+class EmulNet : public Network
 { 	
 private:
 	Params* par;
 	int sent_msgs[MAX_NODES + 1][MAX_TIME];
 	int recv_msgs[MAX_NODES + 1][MAX_TIME];
+	// messages dropped by each receiver because their checksum did not match
+	int corrupt_msgs[MAX_NODES + 1];
+	// messages each sender dropped because the mailbox of the receiver was full
+	int overflow_msgs[MAX_NODES + 1];
 	int enInited;
 	EM emulnet;
 public:
@@ -93,6 +103,8 @@ public:
 	int ENsend(Address *myaddr, Address *toaddr, string data);
 	int ENsend(Address *myaddr, Address *toaddr, char *data, int size);
 	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	int ENmaxPayload();
+	MpscRing<en_msg *> *ENmailbox(int id);
 	int ENcleanup();
 };
 
@@ -0,0 +1,297 @@
+/**********************************
+ * FILE NAME: FlatHashEngine.cpp
+ *
+ * DESCRIPTION: Definition of the open-addressing storage engine
+ **********************************/
+
+#include "FlatHashEngine.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Control byte values. A full slot stores the low 7 bits of its hash (0..127),
+ * so free slots are exactly the ones with the sign bit set.
+ */
+static const int8_t CTRL_EMPTY = -128;
+static const int8_t CTRL_DELETED = -2;
+
+/**
+ * FUNCTION NAME: matchByte
+ *
+ * DESCRIPTION: Compares the GROUP_WIDTH control bytes starting at group with h
+ *
+ * RETURNS:
+ * bitmask with bit i set if group[i] == h
+ */
+static inline uint32_t matchByte(const int8_t *group, int8_t h) {
+#ifdef __SSE2__
+	__m128i ctrlBytes = _mm_loadu_si128((const __m128i *)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrlBytes, _mm_set1_epi8(h)));
+#else
+	uint32_t mask = 0;
+	for ( int i = 0; i < GROUP_WIDTH; i++ ) {
+		if ( group[i] == h ) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * FUNCTION NAME: matchFree
+ *
+ * RETURNS:
+ * bitmask of the EMPTY or DELETED control bytes in the group
+ */
+static inline uint32_t matchFree(const int8_t *group) {
+#ifdef __SSE2__
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+	uint32_t mask = 0;
+	for ( int i = 0; i < GROUP_WIDTH; i++ ) {
+		if ( group[i] < 0 ) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Constructor
+ */
+FlatHashEngine::FlatHashEngine(): ctrl(NULL), slots(NULL), capacity(0), used(0), growthLeft(0) {
+	resize(MIN_CAPACITY);
+}
+
+/**
+ * Destructor
+ */
+FlatHashEngine::~FlatHashEngine() {
+	delete[] ctrl;
+	delete[] slots;
+}
+
+/**
+ * FUNCTION NAME: hashOf
+ *
+ * DESCRIPTION: Hashes the key. The high bits select the probe start (H1),
+ * 				the low 7 bits are kept in the control byte (H2).
+ */
+size_t FlatHashEngine::hashOf(string_view key) {
+	std::hash<string_view> hashFunc;
+	return hashFunc(key);
+}
+
+/**
+ * FUNCTION NAME: setCtrl
+ *
+ * DESCRIPTION: Sets the control byte of a slot, keeping the mirrored tail in sync
+ */
+void FlatHashEngine::setCtrl(size_t index, int8_t h) {
+	ctrl[index] = h;
+	if ( index < GROUP_WIDTH ) {
+		ctrl[capacity + index] = h;
+	}
+}
+
+/**
+ * FUNCTION NAME: findIndex
+ *
+ * DESCRIPTION: Probes group by group until the key or an EMPTY control byte is found
+ *
+ * RETURNS:
+ * slot index of the key
+ * -1 if the key is not present
+ */
+long FlatHashEngine::findIndex(string_view key, size_t hash) {
+	size_t mask = capacity - 1;
+	int8_t h2 = (int8_t)(hash & 0x7F);
+	size_t offset = (hash >> 7) & mask;
+	size_t step = 0;
+
+	while ( true ) {
+		const int8_t *group = ctrl + offset;
+		uint32_t candidates = matchByte(group, h2);
+		while ( candidates ) {
+			size_t index = (offset + __builtin_ctz(candidates)) & mask;
+			if ( slots[index].keySize == key.size() && 0 == memcmp(slots[index].data, key.data(), key.size()) ) {
+				return (long)index;
+			}
+			candidates &= candidates - 1;
+		}
+		if ( matchByte(group, CTRL_EMPTY) ) {
+			// an EMPTY byte ends every probe sequence that could contain the key
+			return -1;
+		}
+		step += GROUP_WIDTH;
+		offset = (offset + step) & mask;
+	}
+}
+
+/**
+ * FUNCTION NAME: findFreeIndex
+ *
+ * DESCRIPTION: Returns the first EMPTY or DELETED slot on the probe sequence of hash
+ */
+size_t FlatHashEngine::findFreeIndex(size_t hash) {
+	size_t mask = capacity - 1;
+	size_t offset = (hash >> 7) & mask;
+	size_t step = 0;
+
+	while ( true ) {
+		uint32_t free = matchFree(ctrl + offset);
+		if ( free ) {
+			return (offset + __builtin_ctz(free)) & mask;
+		}
+		step += GROUP_WIDTH;
+		offset = (offset + step) & mask;
+	}
+}
+
+/**
+ * FUNCTION NAME: resize
+ *
+ * DESCRIPTION: Rehashes every pair into a table of newCapacity slots (a power of two).
+ * 				Called with the current capacity it only purges DELETED slots.
+ */
+void FlatHashEngine::resize(size_t newCapacity) {
+	int8_t *oldCtrl = ctrl;
+	Slot *oldSlots = slots;
+	size_t oldCapacity = capacity;
+
+	capacity = newCapacity;
+	ctrl = new int8_t[capacity + GROUP_WIDTH];
+	memset(ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+	slots = new Slot[capacity];
+	growthLeft = capacity - capacity / 8 - used;
+
+	for ( size_t i = 0; i < oldCapacity; i++ ) {
+		if ( oldCtrl[i] >= 0 ) {
+			size_t hash = hashOf(string_view(oldSlots[i].data, oldSlots[i].keySize));
+			size_t index = findFreeIndex(hash);
+			setCtrl(index, (int8_t)(hash & 0x7F));
+			slots[index] = oldSlots[i];
+		}
+	}
+	delete[] oldCtrl;
+	delete[] oldSlots;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Looks the key up and copies its value out
+ *
+ * RETURNS:
+ * true if found
+ * false otherwise
+ */
+bool FlatHashEngine::find(string_view key, string *value) {
+	long index = findIndex(key, hashOf(key));
+	if ( index < 0 ) {
+		return false;
+	}
+	if ( value ) {
+		value->assign(slots[index].data + slots[index].keySize, slots[index].valueSize);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: mutate
+ *
+ * DESCRIPTION: Hashes and probes the key once, then inserts, overwrites or erases
+ * 				the slot as decide asks. An insert reuses the hash to pick its free slot.
+ */
+void FlatHashEngine::mutate(string_view key, const Mutator &decide) {
+	size_t hash = hashOf(key);
+	long index = findIndex(key, hash);
+	string_view current, replacement;
+
+	if ( index >= 0 ) {
+		current = string_view(slots[index].data + slots[index].keySize, slots[index].valueSize);
+	}
+	MutateAction action = decide(index >= 0 ? &current : NULL, &replacement);
+
+	if ( action == STORE_VALUE && index >= 0 ) {
+		Slot &slot = slots[index];
+		slot.data = arena.reallocate(slot.data, slot.keySize + slot.valueSize, slot.keySize + replacement.size());
+		slot.valueSize = (uint32_t)replacement.size();
+		memcpy(slot.data + slot.keySize, replacement.data(), replacement.size());
+	}
+	else if ( action == STORE_VALUE ) {
+		if ( growthLeft == 0 ) {
+			// grow when live pairs fill more than half of the usable slots, otherwise drop tombstones
+			resize(used * 2 >= capacity - capacity / 8 ? capacity * 2 : capacity);
+		}
+		size_t free = findFreeIndex(hash);
+		if ( ctrl[free] == CTRL_EMPTY ) {
+			growthLeft--;
+		}
+		setCtrl(free, (int8_t)(hash & 0x7F));
+		Slot &slot = slots[free];
+		slot.data = arena.allocate(key.size() + replacement.size());
+		slot.keySize = (uint32_t)key.size();
+		slot.valueSize = (uint32_t)replacement.size();
+		memcpy(slot.data, key.data(), key.size());
+		memcpy(slot.data + key.size(), replacement.data(), replacement.size());
+		used++;
+	}
+	else if ( action == ERASE_VALUE && index >= 0 ) {
+		// the DELETED marker keeps probe sequences through this slot intact
+		setCtrl(index, CTRL_DELETED);
+		arena.deallocate(slots[index].data, slots[index].keySize + slots[index].valueSize);
+		used--;
+	}
+}
+
+/**
+ * FUNCTION NAME: size
+ *
+ * DESCRIPTION: Returns the number of stored pairs
+ */
+unsigned long FlatHashEngine::size() {
+	return (unsigned long)used;
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Removes all pairs and releases the slot array.
+ * 				Key and value bytes go with the arena reset, without visiting the slots.
+ */
+void FlatHashEngine::clear() {
+	arena.reset();
+	delete[] ctrl;
+	delete[] slots;
+	ctrl = NULL;
+	slots = NULL;
+	capacity = 0;
+	used = 0;
+	resize(MIN_CAPACITY);
+}
+
+/**
+ * FUNCTION NAME: scan
+ *
+ * DESCRIPTION: Visits every pair in slot order
+ */
+void FlatHashEngine::scan(const function<void(string_view, string_view)> &visit) {
+	for ( size_t i = 0; i < capacity; i++ ) {
+		if ( ctrl[i] >= 0 ) {
+			visit(string_view(slots[i].data, slots[i].keySize), string_view(slots[i].data + slots[i].keySize, slots[i].valueSize));
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: getStats
+ *
+ * DESCRIPTION: Returns the arena usage of this engine
+ */
+ArenaStats FlatHashEngine::getStats() {
+	return arena.getStats();
+}
@@ -0,0 +1,68 @@
+/**********************************
+ * FILE NAME: FlatHashEngine.h
+ *
+ * DESCRIPTION: Header file of the open-addressing storage engine
+ **********************************/
+
+#ifndef FLATHASHENGINE_H_
+#define FLATHASHENGINE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "StorageEngine.h"
+#include "SlabArena.h"
+#include <stdint.h>
+
+/*
+ * Macros
+ */
+// number of control bytes matched at once by one probe
+#define GROUP_WIDTH 16
+#define MIN_CAPACITY 16
+
+/**
+ * CLASS NAME: FlatHashEngine
+ *
+ * DESCRIPTION: SwissTable-style open-addressing hash table.
+ * 				One control byte per slot holds 7 bits of the key hash (or EMPTY/DELETED),
+ * 				so a probe compares GROUP_WIDTH slots with a single SIMD compare and only
+ * 				touches the slots whose control byte matches.
+ * 				A slot is 16 bytes: the key and value bytes share one chunk of the engine's arena.
+ */
+class FlatHashEngine : public StorageEngine {
+private:
+	class Slot {
+	public:
+		// key bytes followed by value bytes
+		char *data;
+		uint32_t keySize;
+		uint32_t valueSize;
+	};
+	SlabArena arena;
+	// capacity + GROUP_WIDTH bytes; the tail mirrors the first GROUP_WIDTH bytes
+	int8_t *ctrl;
+	Slot *slots;
+	size_t capacity;
+	size_t used;
+	// inserts left before the load factor (7/8) is reached, counting DELETED slots as used
+	size_t growthLeft;
+
+	size_t hashOf(string_view key);
+	long findIndex(string_view key, size_t hash);
+	size_t findFreeIndex(size_t hash);
+	void setCtrl(size_t index, int8_t h);
+	void resize(size_t newCapacity);
+public:
+	FlatHashEngine();
+	bool find(string_view key, string *value);
+	void mutate(string_view key, const Mutator &decide);
+	unsigned long size();
+	void clear();
+	void scan(const function<void(string_view, string_view)> &visit);
+	ArenaStats getStats();
+	virtual ~FlatHashEngine();
+};
+
+#endif /* FLATHASHENGINE_H_ */
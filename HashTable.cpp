@@ -5,22 +5,141 @@
  **********************************/
 
 #include "HashTable.h"
+#include "FlatHashEngine.h"
+#include "LSMEngine.h"
+#include "TokenEngine.h"
+#include "ValueLogEngine.h"
 
-HashTable::HashTable() {}
+HashTable::HashTable(storageTYPE backend): sequence(0), openViews(0) {
+	Shard *shard = new Shard();
+	shard->engine = newEngine(backend);
+	shards.push_back(shard);
+}
+
+/**
+ * Constructor
+ *
+ * DESCRIPTION: Builds the STORAGE_SHARDS engines configured in par, at least one per
+ * 				worker thread. A disk backed engine (LSM_STORAGE) and the value log
+ * 				(VALUE_LOG_THRESHOLD) keep their files in dataDir, which must be private
+ * 				to this table; with several shards each one gets dataDir_<shard>.
+ */
+HashTable::HashTable(Params *par, string dataDir): sequence(0), openViews(0) {
+	int count = max(max(par->STORAGE_SHARDS, par->WORKER_THREADS), 1);
+	for ( int i = 0; i < count; i++ ) {
+		Shard *shard = new Shard();
+		string shardDir = count == 1 ? dataDir : dataDir + "_" + to_string(i);
+		if ( par->STORAGE_BACKEND == LSM_STORAGE ) {
+			shard->engine = new LSMEngine(shardDir, par->MEMTABLE_SIZE);
+		}
+		else {
+			shard->engine = newEngine(par->STORAGE_BACKEND);
+		}
+		if ( par->VALUE_LOG_THRESHOLD > 0 ) {
+			shard->engine = new ValueLogEngine(shard->engine, shardDir, par->VALUE_LOG_THRESHOLD);
+		}
+		shards.push_back(shard);
+	}
+}
+
+/**
+ * FUNCTION NAME: newEngine
+ *
+ * DESCRIPTION: Builds one of the in-memory engines
+ */
+StorageEngine *HashTable::newEngine(storageTYPE backend) {
+	if ( backend == FLAT_STORAGE ) {
+		return new FlatHashEngine();
+	}
+	if ( backend == TOKEN_STORAGE ) {
+		return new TokenEngine();
+	}
+	return new MapEngine();
+}
 
-HashTable::~HashTable() {}
+HashTable::~HashTable() {
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		delete shards[i]->engine;
+		delete shards[i];
+	}
+}
+
+/**
+ * FUNCTION NAME: shardOf
+ *
+ * DESCRIPTION: Returns the index of the shard holding the key. The hash is mixed and
+ * 				its high bits are used, so that shards do not correlate with ring tokens
+ * 				or with the bits the engines index by.
+ */
+unsigned int HashTable::shardOf(string_view key) {
+	if ( shards.size() == 1 ) {
+		return 0;
+	}
+	std::hash<string_view> hashFunc;
+	uint64_t mixed = (uint64_t)hashFunc(key) * 0x9E3779B97F4A7C15ull;
+	return (unsigned int)((mixed >> 32) % shards.size());
+}
+
+/**
+ * FUNCTION NAME: shardCount
+ *
+ * DESCRIPTION: Returns the number of shards
+ */
+unsigned int HashTable::shardCount() {
+	return (unsigned int)shards.size();
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Looks the key up in its shard, holding the shard lock shared
+ */
+bool HashTable::find(string_view key, string *value) {
+	Shard *shard = shards[shardOf(key)];
+	shared_lock<shared_mutex> guard(shard->lock);
+	return shard->engine->find(key, value);
+}
+
+/**
+ * FUNCTION NAME: mutate
+ *
+ * DESCRIPTION: Applies decide to the key in its shard, holding the shard lock exclusively.
+ * 				While views are open the value it replaces is kept as a version.
+ */
+void HashTable::mutate(string_view key, const Mutator &decide) {
+	Shard *shard = shards[shardOf(key)];
+	unique_lock<shared_mutex> guard(shard->lock);
+	if ( openViews == 0 ) {
+		shard->engine->mutate(key, decide);
+		return;
+	}
+	shard->engine->mutate(key, [&](const string_view *current, string_view *replacement) {
+		MutateAction action = decide(current, replacement);
+		if ( action != KEEP_VALUE ) {
+			Version version;
+			version.superseded = ++sequence;
+			version.present = current != NULL;
+			if ( current ) {
+				version.value.assign(current->data(), current->size());
+			}
+			shard->versions[string(key)].push_back(std::move(version));
+		}
+		return action;
+	});
+}
 
 /**
  * FUNCTION NAME: create
  *
  * DESCRIPTION: This function inserts they (key,value) pair into the local hash table
+ * 				An existing key keeps its value
  *
  * RETURNS:
  * true on SUCCESS
  * false in FAILURE
  */
-bool HashTable::create(string key, string value) {
-	hashTable.emplace(key, value);
+bool HashTable::create(string_view key, string_view value) {
+	insertIfAbsent(key, value);
 	return true;
 }
 
@@ -33,13 +152,12 @@ bool HashTable::create(string key, string value) {
  * string value if found
  * else it returns a NULL
  */
-string HashTable::read(string key) {
-	map<string, string>::iterator search;
+string HashTable::read(string_view key) {
+	string value;
 
-	search = hashTable.find(key);
-	if ( search != hashTable.end() ) {
+	if ( find(key, &value) ) {
 		// Value found
-		return search->second;
+		return value;
 	}
 	else {
 		// Value not found
@@ -57,18 +175,19 @@ string HashTable::read(string key) {
  * true on SUCCESS
  * false on FAILURE
  */
-bool HashTable::update(string key, string newValue) {
-	map<string, string>::iterator update;
+bool HashTable::update(string_view key, string_view newValue) {
+	bool found = false;
 
-	if (read(key).empty()) {
-		// Key not found
-		return false;
-	}
-	// Key found
-	//update = hashTable.at(key) = newValue;
-	hashTable.at(key) = newValue;
-	// Update successful
-	return true;
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		if ( current == NULL ) {
+			// Key not found
+			return KEEP_VALUE;
+		}
+		found = true;
+		*replacement = newValue;
+		return STORE_VALUE;
+	});
+	return found;
 }
 
 /**
@@ -80,20 +199,238 @@ bool HashTable::update(string key, string newValue) {
  * true on SUCCESS
  * false on FAILURE
  */
-bool HashTable::deleteKey(string key) {
-	uint eraseCount = 0;
+bool HashTable::deleteKey(string_view key) {
+	return erase(key, NULL);
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Copies the value of the key into *value
+ *
+ * RETURNS:
+ * true if the key is found
+ * false otherwise
+ */
+bool HashTable::get(string_view key, string *value) {
+	return find(key, value);
+}
+
+/**
+ * FUNCTION NAME: upsert
+ *
+ * DESCRIPTION: Sets the value of the key, inserting the key if needed
+ *
+ * RETURNS:
+ * true if the key was inserted
+ * false if an existing value was replaced
+ */
+bool HashTable::upsert(string_view key, string_view value) {
+	bool inserted = false;
+
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		inserted = current == NULL;
+		*replacement = value;
+		return STORE_VALUE;
+	});
+	return inserted;
+}
+
+/**
+ * FUNCTION NAME: insertIfAbsent
+ *
+ * DESCRIPTION: Inserts the (key,value) pair only if the key is not present
+ *
+ * RETURNS:
+ * true if the pair was inserted
+ * false if the key already exists
+ */
+bool HashTable::insertIfAbsent(string_view key, string_view value) {
+	bool inserted = false;
+
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		if ( current != NULL ) {
+			return KEEP_VALUE;
+		}
+		inserted = true;
+		*replacement = value;
+		return STORE_VALUE;
+	});
+	return inserted;
+}
+
+/**
+ * FUNCTION NAME: compareAndSet
+ *
+ * DESCRIPTION: Replaces the value of the key with newValue only if it currently equals expected
+ *
+ * RETURNS:
+ * true if the value was replaced
+ * false if the key is absent or holds another value
+ */
+bool HashTable::compareAndSet(string_view key, string_view expected, string_view newValue) {
+	bool swapped = false;
+
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		if ( current == NULL || *current != expected ) {
+			return KEEP_VALUE;
+		}
+		swapped = true;
+		*replacement = newValue;
+		return STORE_VALUE;
+	});
+	return swapped;
+}
+
+/**
+ * FUNCTION NAME: erase
+ *
+ * DESCRIPTION: Removes the key, handing its value to *oldValue if not NULL
+ *
+ * RETURNS:
+ * true if the key was removed
+ * false if the key is not found
+ */
+bool HashTable::erase(string_view key, string *oldValue) {
+	bool found = false;
+
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		if ( current == NULL ) {
+			return KEEP_VALUE;
+		}
+		found = true;
+		if ( oldValue ) {
+			oldValue->assign(current->data(), current->size());
+		}
+		return ERASE_VALUE;
+	});
+	return found;
+}
+
+/**
+ * FUNCTION NAME: putIfNewer
+ *
+ * DESCRIPTION: Stores record (an encoded Record) unless the key holds a record with
+ * 				the same or a later timestamp. With mustExist an absent, deleted or
+ * 				expired (by globaltime now) key is left as is.
+ *
+ * RETURNS:
+ * WRITE_APPLIED if record was stored
+ * WRITE_STALE if the stored record is as recent or more recent
+ * WRITE_ABSENT if mustExist and the key is absent, deleted or expired
+ */
+writeRESULT HashTable::putIfNewer(string_view key, string_view record, bool mustExist, uint32_t now) {
+	writeRESULT result = WRITE_ABSENT;
+
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		if ( mustExist && (current == NULL || !Record::isLive(*current, now)) ) {
+			return KEEP_VALUE;
+		}
+		if ( current != NULL && Record::timestampOf(record) <= Record::timestampOf(*current) ) {
+			result = WRITE_STALE;
+			return KEEP_VALUE;
+		}
+		result = WRITE_APPLIED;
+		*replacement = record;
+		return STORE_VALUE;
+	});
+	return result;
+}
+
+/**
+ * FUNCTION NAME: deleteIfNewer
+ *
+ * DESCRIPTION: Replaces the record of the key with a tombstone, unless it was written
+ * 				after timestamp. An absent key gets the tombstone too, so a write older
+ * 				than the delete arriving later (a late replica, a stabilization resend)
+ * 				cannot bring the key back.
+ *
+ * RETURNS:
+ * WRITE_APPLIED if a live record was deleted
+ * WRITE_STALE if the stored record is more recent
+ * WRITE_ABSENT if the key was absent, already deleted or expired by globaltime now
+ */
+writeRESULT HashTable::deleteIfNewer(string_view key, uint64_t timestamp, uint32_t now) {
+	writeRESULT result = WRITE_ABSENT;
+	string tombstone;
+
+	Record::encode(tombstone, timestamp, RECORD_TOMBSTONE, "");
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		if ( current != NULL && timestamp < Record::timestampOf(*current) ) {
+			result = WRITE_STALE;
+			return KEEP_VALUE;
+		}
+		if ( current != NULL && Record::isLive(*current, now) ) {
+			result = WRITE_APPLIED;
+		}
+		*replacement = tombstone;
+		return STORE_VALUE;
+	});
+	return result;
+}
+
+/**
+ * FUNCTION NAME: expireIfDue
+ *
+ * DESCRIPTION: Replaces the record of the key with a tombstone if its TTL ran out by
+ * 				globaltime now, which frees the value. The tombstone keeps the record's
+ * 				timestamp, so a later write still wins over it.
+ *
+ * RETURNS:
+ * true if the key expired
+ * false if it is absent, deleted, has no TTL or has not expired yet
+ */
+bool HashTable::expireIfDue(string_view key, uint32_t now) {
+	bool expired = false;
+	string tombstone;
+
+	mutate(key, [&](const string_view *current, string_view *replacement) {
+		Record record;
+		if ( current == NULL || !Record::decode(*current, &record) || record.expiry == 0 ||
+				record.isLive(now) || (record.flags & RECORD_TOMBSTONE) ) {
+			return KEEP_VALUE;
+		}
+		expired = true;
+		Record::encode(tombstone, record.timestamp, RECORD_TOMBSTONE, "");
+		*replacement = tombstone;
+		return STORE_VALUE;
+	});
+	return expired;
+}
+
+/**
+ * FUNCTION NAME: purgeTombstones
+ *
+ * DESCRIPTION: Erases the tombstones of one shard written before horizon. The shard is
+ * 				scanned under its shared lock and each key is then erased on its own,
+ * 				so readers and writers are only held up for a single key at a time.
+ *
+ * RETURNS:
+ * number of tombstones erased
+ */
+unsigned long HashTable::purgeTombstones(uint64_t horizon, unsigned int shard) {
+	vector<string> expired;
+	unsigned long purged = 0;
 
-	if (read(key).empty()) {
-		// Key not found
-		return false;
+	{
+		shared_lock<shared_mutex> guard(shards[shard]->lock);
+		shards[shard]->engine->scan([&](string_view key, string_view record) {
+			if ( Record::isTombstone(record) && Record::timestampOf(record) < horizon ) {
+				expired.emplace_back(key);
+			}
+		});
 	}
-	eraseCount = hashTable.erase(key);
-	if ( eraseCount < 1 ) {
-		// Could not erase
-		return false;
+	for ( unsigned int i = 0; i < expired.size(); i++ ) {
+		// the key may have been written again since the scan
+		mutate(expired[i], [&](const string_view *current, string_view *replacement) {
+			if ( current == NULL || !Record::isTombstone(*current) || Record::timestampOf(*current) >= horizon ) {
+				return KEEP_VALUE;
+			}
+			purged++;
+			return ERASE_VALUE;
+		});
 	}
-	// Delete was successful
-	return true;
+	return purged;
 }
 
 /**
@@ -106,7 +443,7 @@ bool HashTable::deleteKey(string key) {
  * false otherwise
  */
 bool HashTable::isEmpty() {
-	return hashTable.empty();
+	return currentSize() == 0;
 }
 
 /**
@@ -118,7 +455,12 @@ bool HashTable::isEmpty() {
  * size of the table as unit
  */
 unsigned long HashTable::currentSize() {
-	return (unsigned  long)hashTable.size();
+	unsigned long size = 0;
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		shared_lock<shared_mutex> guard(shards[i]->lock);
+		size += shards[i]->engine->size();
+	}
+	return size;
 }
 
 /**
@@ -127,7 +469,25 @@ unsigned long HashTable::currentSize() {
  * DESCRIPTION: Clear all contents from the hash table
  */
 void HashTable::clear() {
-	hashTable.clear();
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		unique_lock<shared_mutex> guard(shards[i]->lock);
+		shards[i]->engine->clear();
+	}
+}
+
+/**
+ * FUNCTION NAME: mayContain
+ *
+ * DESCRIPTION: Cheap membership test answered from memory
+ *
+ * RETURNS:
+ * false if the key is certainly absent
+ * true if it may be present (confirm with read)
+ */
+bool HashTable::mayContain(string_view key) {
+	Shard *shard = shards[shardOf(key)];
+	shared_lock<shared_mutex> guard(shard->lock);
+	return shard->engine->mayContain(key);
 }
 
 /**
@@ -138,7 +498,277 @@ void HashTable::clear() {
  * RETURNS:
  * unsigned long count (Should be always 1)
  */
-unsigned long HashTable::count(string key) {
-	return (unsigned long) hashTable.count(key);
+unsigned long HashTable::count(string_view key) {
+	return find(key, NULL) ? 1 : 0;
+}
+
+/**
+ * FUNCTION NAME: scan
+ *
+ * DESCRIPTION: Visits every (key,value) pair of the hash table, one shard after the other.
+ * 				visit must not modify the table.
+ */
+void HashTable::scan(const function<void(string_view, string_view)> &visit) {
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		shared_lock<shared_mutex> guard(shards[i]->lock);
+		shards[i]->engine->scan(visit);
+	}
+}
+
+/**
+ * FUNCTION NAME: scanRange
+ *
+ * DESCRIPTION: Visits the pairs whose token lies in the ring range [first, last).
+ * 				The range wraps around the ring when first >= last.
+ * 				Token order holds within each shard. visit must not modify the table.
+ */
+void HashTable::scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit) {
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		shared_lock<shared_mutex> guard(shards[i]->lock);
+		if ( first < last ) {
+			shards[i]->engine->scanRange(first, last, visit);
+		}
+		else {
+			shards[i]->engine->scanRange(first, RING_SIZE, visit);
+			shards[i]->engine->scanRange(0, last, visit);
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: openView
+ *
+ * DESCRIPTION: Opens a read view of the table as it is now, to pass to getAt, scanAt and
+ * 				scanRangeAt until closeView. Views cost a copy of every value replaced
+ * 				while they are open; opening one only waits for the writes in progress,
+ * 				a shard at a time.
+ *
+ * RETURNS:
+ * the view, the sequence number it reads at
+ */
+uint64_t HashTable::openView() {
+	// from here on every write keeps its version; a write that started before, and so
+	// may not, holds its shard lock until done: passing each lock once waits for them
+	openViews++;
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		shared_lock<shared_mutex> barrier(shards[i]->lock);
+	}
+	lock_guard<mutex> guard(viewLock);
+	uint64_t view = sequence;
+	views.insert(view);
+	return view;
+}
+
+/**
+ * FUNCTION NAME: closeView
+ *
+ * DESCRIPTION: Closes a view and reclaims the versions no open view can read anymore:
+ * 				the open views' sequence numbers act as epochs, and a version is freed
+ * 				once the oldest of them is past the write that superseded it.
+ */
+void HashTable::closeView(uint64_t view) {
+	uint64_t oldest;
+
+	{
+		lock_guard<mutex> guard(viewLock);
+		views.erase(views.find(view));
+		openViews--;
+		// with no view open, versions kept by writes that raced this close are freed by the next one
+		oldest = views.empty() ? sequence.load() : *views.begin();
+	}
+	reclaimVersions(oldest);
+}
+
+/**
+ * FUNCTION NAME: reclaimVersions
+ *
+ * DESCRIPTION: Frees the versions superseded at or before sequence number oldest
+ */
+void HashTable::reclaimVersions(uint64_t oldest) {
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		unique_lock<shared_mutex> guard(shards[i]->lock);
+		auto &versions = shards[i]->versions;
+		for ( auto it = versions.begin(); it != versions.end(); ) {
+			vector<Version> &chain = it->second;
+			unsigned int kept = 0;
+			while ( kept < chain.size() && chain[kept].superseded <= oldest ) {
+				kept++;
+			}
+			chain.erase(chain.begin(), chain.begin() + kept);
+			it = chain.empty() ? versions.erase(it) : ++it;
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: findVersion
+ *
+ * DESCRIPTION: Returns the version of the key a view reads, NULL if it reads the current
+ * 				value. The caller holds the shard lock.
+ */
+const HashTable::Version *HashTable::findVersion(Shard *shard, string_view key, uint64_t view) {
+	if ( shard->versions.empty() ) {
+		return NULL;
+	}
+	auto it = shard->versions.find(key);
+	if ( it == shard->versions.end() ) {
+		return NULL;
+	}
+	// the first write after the view replaced the value the view reads
+	for ( unsigned int i = 0; i < it->second.size(); i++ ) {
+		if ( it->second[i].superseded > view ) {
+			return &it->second[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * FUNCTION NAME: getAt
+ *
+ * DESCRIPTION: Reads the value of the key as of the view
+ *
+ * RETURNS:
+ * true if the key was present
+ * false otherwise
+ */
+bool HashTable::getAt(string_view key, uint64_t view, string *value) {
+	Shard *shard = shards[shardOf(key)];
+	shared_lock<shared_mutex> guard(shard->lock);
+	const Version *version = findVersion(shard, key, view);
+	if ( version == NULL ) {
+		return shard->engine->find(key, value);
+	}
+	if ( version->present && value ) {
+		*value = version->value;
+	}
+	return version->present;
+}
+
+/**
+ * FUNCTION NAME: keysOf
+ *
+ * DESCRIPTION: Copies the keys of one shard in the token range [first, last) into keys,
+ * 				those erased but still kept as versions included; first == last means
+ * 				the whole ring. Holds the shard lock shared only while copying.
+ */
+void HashTable::keysOf(Shard *shard, size_t first, size_t last, vector<string> *keys) {
+	auto collect = [keys](string_view key, string_view) {
+		keys->emplace_back(key);
+	};
+	shared_lock<shared_mutex> guard(shard->lock);
+	if ( first == last ) {
+		shard->engine->scan(collect);
+	}
+	else if ( first < last ) {
+		shard->engine->scanRange(first, last, collect);
+	}
+	else {
+		shard->engine->scanRange(first, RING_SIZE, collect);
+		shard->engine->scanRange(0, last, collect);
+	}
+
+	// keys erased since a view are only left in the versions
+	for ( auto &entry : shard->versions ) {
+		size_t position = token(entry.first);
+		bool inRange = first == last || (first < last ? position >= first && position < last : position >= first || position < last);
+		if ( inRange && !shard->engine->find(entry.first, NULL) ) {
+			keys->push_back(entry.first);
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: scanShardsAt
+ *
+ * DESCRIPTION: Visits the pairs in the token range [first, last) as of the view, a shard
+ * 				at a time: the keys of the shard are copied out under its lock, then each
+ * 				is read as of the view with getAt, and visited with no lock held.
+ * 				Writes in between keep the versions the view reads, so the scan still
+ * 				sees every shard at the same point in time.
+ */
+void HashTable::scanShardsAt(size_t first, size_t last, uint64_t view, const function<void(string_view, string_view)> &visit) {
+	vector<string> keys;
+	string value;
+
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		keys.clear();
+		keysOf(shards[i], first, last, &keys);
+		for ( const string &key : keys ) {
+			if ( getAt(key, view, &value) ) {
+				visit(key, value);
+			}
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: scanAt
+ *
+ * DESCRIPTION: Visits every pair as of the view. No lock is held while visit runs, so it
+ * 				may take its time, or write to the table.
+ */
+void HashTable::scanAt(uint64_t view, const function<void(string_view, string_view)> &visit) {
+	scanShardsAt(0, 0, view, visit);
+}
+
+/**
+ * FUNCTION NAME: scanRangeAt
+ *
+ * DESCRIPTION: Visits the pairs whose token lies in the ring range [first, last) as of the
+ * 				view. The range wraps around the ring when first >= last.
+ */
+void HashTable::scanRangeAt(size_t first, size_t last, uint64_t view, const function<void(string_view, string_view)> &visit) {
+	if ( first == last ) {
+		// scanRange covers the whole ring when the bounds meet
+		first = 0;
+		last = RING_SIZE;
+	}
+	scanShardsAt(first, last, view, visit);
+}
+
+/**
+ * FUNCTION NAME: token
+ *
+ * DESCRIPTION: Returns the position of the key on the ring
+ */
+size_t HashTable::token(string_view key) {
+	return StorageEngine::tokenOf(key);
+}
+
+/**
+ * FUNCTION NAME: sync
+ *
+ * DESCRIPTION: Syncs the engine of every shard; a disk backed engine moves the
+ * 				data it buffers in memory to its files
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE if any shard failed
+ */
+int HashTable::sync() {
+	int result = SUCCESS;
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		unique_lock<shared_mutex> guard(shards[i]->lock);
+		if ( shards[i]->engine->sync() == FAILURE ) {
+			result = FAILURE;
+		}
+	}
+	return result;
+}
+
+/**
+ * FUNCTION NAME: stats
+ *
+ * DESCRIPTION: Returns the bytes used versus the bytes reserved for keys and values
+ */
+ArenaStats HashTable::stats() {
+	ArenaStats total;
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		shared_lock<shared_mutex> guard(shards[i]->lock);
+		ArenaStats shard = shards[i]->engine->getStats();
+		total.bytesUsed += shard.bytesUsed;
+		total.bytesReserved += shard.bytesReserved;
+	}
+	return total;
 }
 
@@ -13,26 +13,102 @@
 #include "stdincludes.h"
 #include "common.h"
 #include "Entry.h"
+#include "Params.h"
+#include "StorageEngine.h"
+#include "Record.h"
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <set>
+
+// outcome of a last-write-wins write
+enum writeRESULT { WRITE_APPLIED, WRITE_STALE, WRITE_ABSENT };
 
 /**
  * CLASS NAME: HashTable
  *
- * DESCRIPTION: This class is a wrapper to the map provided by C++ STL.
+ * DESCRIPTION: This class is the local key value store of a node.
+ * 				Pairs live in a StorageEngine selected at construction:
+ * 				MAP_STORAGE (ordered map provided by C++ STL), FLAT_STORAGE (open addressing)
+ * 				TOKEN_STORAGE (ordered by ring token, for range streaming)
+ * 				or LSM_STORAGE (memtable and SSTables on disk, for data sets larger than RAM).
+ * 				With VALUE_LOG_THRESHOLD, large values are moved out of the engine into a value log.
+ * 				Every operation looks the key up once; keys are taken as string_view
+ * 				so callers never build a temporary string.
+ * 				Keys are spread over shards, each one an engine behind its own
+ * 				reader/writer lock, so worker threads may use the table concurrently.
+ * 				A read view (openView) reads the table as it was when opened: while views
+ * 				are open, every value replaced or erased is kept as an older version of its
+ * 				key, until no open view is older than the write that replaced it.
  *
  */
 class HashTable {
+private:
+	// a value as it was before the write with sequence number superseded (absent if !present)
+	class Version {
+	public:
+		uint64_t superseded;
+		bool present;
+		string value;
+	};
+	class Shard {
+	public:
+		StorageEngine *engine;
+		shared_mutex lock;
+		// older versions of the keys written while views are open, oldest first;
+		// ordered with less<> so a string_view finds its key without a copy
+		map<string, vector<Version>, less<> > versions;
+	};
+	vector<Shard *> shards;
+	// sequence number of the last write that kept a version
+	atomic<uint64_t> sequence;
+	atomic<int> openViews;
+	// sequence numbers the open views read at
+	multiset<uint64_t> views;
+	mutex viewLock;
+	static StorageEngine *newEngine(storageTYPE backend);
+	bool find(string_view key, string *value);
+	void mutate(string_view key, const Mutator &decide);
+	const Version *findVersion(Shard *shard, string_view key, uint64_t view);
+	void keysOf(Shard *shard, size_t first, size_t last, vector<string> *keys);
+	void scanShardsAt(size_t first, size_t last, uint64_t view, const function<void(string_view, string_view)> &visit);
+	void reclaimVersions(uint64_t oldest);
 public:
-	map<string, string> hashTable;
-//public:
-	HashTable();
-	bool create(string key, string value);
-	string read(string key);
-	bool update(string key, string newValue);
-	bool deleteKey(string key);
+	HashTable(storageTYPE backend = MAP_STORAGE);
+	HashTable(Params *par, string dataDir);
+	bool create(string_view key, string_view value);
+	string read(string_view key);
+	bool update(string_view key, string_view newValue);
+	bool deleteKey(string_view key);
+	// lookup-once mutations
+	bool get(string_view key, string *value);
+	bool upsert(string_view key, string_view value);
+	bool insertIfAbsent(string_view key, string_view value);
+	bool compareAndSet(string_view key, string_view expected, string_view newValue);
+	bool erase(string_view key, string *oldValue = NULL);
+	// last-write-wins on values encoded as Records
+	writeRESULT putIfNewer(string_view key, string_view record, bool mustExist, uint32_t now = 0);
+	writeRESULT deleteIfNewer(string_view key, uint64_t timestamp, uint32_t now = 0);
+	bool expireIfDue(string_view key, uint32_t now);
+	unsigned long purgeTombstones(uint64_t horizon, unsigned int shard);
 	bool isEmpty();
 	unsigned long currentSize();
 	void clear();
-	unsigned long count(string key);
+	bool mayContain(string_view key);
+	unsigned long count(string_view key);
+	void scan(const function<void(string_view, string_view)> &visit);
+	void scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit);
+	static size_t token(string_view key);
+	// multi-version reads
+	uint64_t openView();
+	void closeView(uint64_t view);
+	bool getAt(string_view key, uint64_t view, string *value);
+	void scanAt(uint64_t view, const function<void(string_view, string_view)> &visit);
+	void scanRangeAt(size_t first, size_t last, uint64_t view, const function<void(string_view, string_view)> &visit);
+	unsigned int shardOf(string_view key);
+	unsigned int shardCount();
+	int sync();
+	ArenaStats stats();
 	virtual ~HashTable();
 };
 
@@ -0,0 +1,52 @@
+/**********************************
+ * FILE NAME: HybridClock.cpp
+ *
+ * DESCRIPTION: Definition of the hybrid logical clock of a node
+ **********************************/
+
+#include "HybridClock.h"
+
+#define NODE_MASK (((uint64_t)1 << HLC_LOGICAL_SHIFT) - 1)
+
+/**
+ * Constructor
+ */
+HybridClock::HybridClock(Params *par, uint16_t nodeId): par(par), nodeId(nodeId), last(0) {}
+
+/**
+ * FUNCTION NAME: now
+ *
+ * DESCRIPTION: Returns a new timestamp, greater than any returned or observed so far
+ */
+uint64_t HybridClock::now() {
+	uint64_t physical = (uint64_t)par->getcurrtime() << HLC_PHYSICAL_SHIFT;
+	if ( physical > last ) {
+		last = physical;
+	}
+	else {
+		// same tick (or clock behind an observed one): bump the logical counter
+		last += (uint64_t)1 << HLC_LOGICAL_SHIFT;
+	}
+	return last | nodeId;
+}
+
+/**
+ * FUNCTION NAME: observe
+ *
+ * DESCRIPTION: Moves the clock past a timestamp received from another node
+ */
+void HybridClock::observe(uint64_t timestamp) {
+	timestamp &= ~NODE_MASK;
+	if ( timestamp > last ) {
+		last = timestamp;
+	}
+}
+
+/**
+ * FUNCTION NAME: physicalTime
+ *
+ * DESCRIPTION: Returns the globaltime at which a timestamp was taken
+ */
+uint64_t HybridClock::physicalTime(uint64_t timestamp) {
+	return timestamp >> HLC_PHYSICAL_SHIFT;
+}
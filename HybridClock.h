@@ -0,0 +1,45 @@
+/**********************************
+ * FILE NAME: HybridClock.h
+ *
+ * DESCRIPTION: Header file of the hybrid logical clock of a node
+ **********************************/
+
+#ifndef HYBRIDCLOCK_H_
+#define HYBRIDCLOCK_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "Params.h"
+#include <stdint.h>
+
+/*
+ * Macros
+ */
+// timestamp layout: [32 bits physical time][16 bits logical counter][16 bits node id]
+#define HLC_LOGICAL_SHIFT 16
+#define HLC_PHYSICAL_SHIFT 32
+
+/**
+ * CLASS NAME: HybridClock
+ *
+ * DESCRIPTION: Hybrid logical clock. Timestamps follow Params::globaltime, never go
+ * 				backwards and are ahead of every timestamp the node has observed, so a
+ * 				write always supersedes the writes it could have seen. The node id in the
+ * 				low bits makes timestamps of different nodes distinct.
+ */
+class HybridClock {
+private:
+	Params *par;
+	uint64_t nodeId;
+	// physical and logical parts of the last timestamp, node id cleared
+	uint64_t last;
+public:
+	HybridClock(Params *par, uint16_t nodeId);
+	uint64_t now();
+	void observe(uint64_t timestamp);
+	static uint64_t physicalTime(uint64_t timestamp);
+};
+
+#endif /* HYBRIDCLOCK_H_ */
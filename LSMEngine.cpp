@@ -0,0 +1,440 @@
+/**********************************
+ * FILE NAME: LSMEngine.cpp
+ *
+ * DESCRIPTION: Definition of the log-structured merge tree backend
+ **********************************/
+
+#include "LSMEngine.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+/**
+ * CLASS NAME: MemSource
+ *
+ * DESCRIPTION: EntrySource over the memtable, used to flush and scan it
+ */
+template <class Table>
+class MemSource : public EntrySource {
+private:
+	typename Table::const_iterator it;
+	typename Table::const_iterator end;
+public:
+	MemSource(const Table &table): it(table.begin()), end(table.end()) {}
+	bool valid() {
+		return it != end;
+	}
+	string_view key() {
+		return it->first;
+	}
+	string_view value() {
+		return it->second.value;
+	}
+	bool deleted() {
+		return it->second.deleted;
+	}
+	void next() {
+		it++;
+	}
+};
+
+/**
+ * Constructor
+ */
+LSMEngine::LSMEngine(string dir, unsigned long memtableSize): dir(dir), memtableSize(memtableSize) {
+	memtableBytes = 0;
+	liveKeys = 0;
+	nextSeq = 1;
+	compactionDone = false;
+	mkdir(dir.c_str(), 0755);
+	load();
+}
+
+/**
+ * Destructor
+ */
+LSMEngine::~LSMEngine() {
+	flush();
+	waitCompaction();
+}
+
+/**
+ * FUNCTION NAME: tablePath
+ *
+ * DESCRIPTION: Returns the file name of the table covering flushes firstSeq..lastSeq
+ */
+string LSMEngine::tablePath(uint64_t firstSeq, uint64_t lastSeq) {
+	char name[64];
+	sprintf(name, "/sst_%lu_%lu.sst", (unsigned long)firstSeq, (unsigned long)lastSeq);
+	return dir + name;
+}
+
+/**
+ * FUNCTION NAME: load
+ *
+ * DESCRIPTION: Opens the SSTables left in the directory by a previous run.
+ * 				Unfinished writes (*.tmp) are removed, and so are the inputs of a compaction
+ * 				that was interrupted after its output was renamed into place.
+ */
+void LSMEngine::load() {
+	DIR *d = opendir(dir.c_str());
+	if ( d == NULL ) {
+		return;
+	}
+	vector<pair<uint64_t, uint64_t> > ranges;
+	struct dirent *e;
+	while ( (e = readdir(d)) != NULL ) {
+		unsigned long firstSeq, lastSeq;
+		int length = 0;
+		string name = e->d_name;
+		if ( name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0 ) {
+			unlink((dir + "/" + name).c_str());
+		}
+		else if ( sscanf(e->d_name, "sst_%lu_%lu.sst%n", &firstSeq, &lastSeq, &length) == 2 && length == (int)name.size() ) {
+			ranges.push_back(make_pair((uint64_t)lastSeq, (uint64_t)firstSeq));
+		}
+	}
+	closedir(d);
+
+	// newest first
+	sort(ranges.rbegin(), ranges.rend());
+	for ( unsigned int i = 0; i < ranges.size(); i++ ) {
+		uint64_t lastSeq = ranges[i].first, firstSeq = ranges[i].second;
+		bool covered = false;
+		for ( unsigned int j = 0; j < ranges.size(); j++ ) {
+			if ( j != i && ranges[j].second <= firstSeq && lastSeq <= ranges[j].first ) {
+				covered = true;
+			}
+		}
+		if ( covered ) {
+			unlink(tablePath(firstSeq, lastSeq).c_str());
+			continue;
+		}
+		shared_ptr<SSTable> table(new SSTable(tablePath(firstSeq, lastSeq), firstSeq, lastSeq));
+		if ( table->open() == SUCCESS ) {
+			tables.push_back(table);
+		}
+		if ( lastSeq >= nextSeq ) {
+			nextSeq = lastSeq + 1;
+		}
+	}
+
+	scan([this](string_view key, string_view value) {
+		liveKeys++;
+	});
+}
+
+/**
+ * FUNCTION NAME: searchTables
+ *
+ * DESCRIPTION: Looks the key up in the SSTables, newest first.
+ * 				Tables whose bloom filter rules the key out cost no I/O.
+ */
+lookupRESULT LSMEngine::searchTables(string_view key, string *value) {
+	lock_guard<mutex> guard(tablesLock);
+	for ( unsigned int i = 0; i < tables.size(); i++ ) {
+		lookupRESULT result = tables[i]->get(key, value);
+		if ( result != KEY_ABSENT ) {
+			return result;
+		}
+	}
+	return KEY_ABSENT;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Looks the key up in the memtable, then in the SSTables
+ */
+bool LSMEngine::find(string_view key, string *value) {
+	Memtable::iterator it = memtable.find(key);
+	if ( it != memtable.end() ) {
+		if ( it->second.deleted ) {
+			return false;
+		}
+		if ( value ) {
+			*value = it->second.value;
+		}
+		return true;
+	}
+	return searchTables(key, value) == KEY_FOUND;
+}
+
+/**
+ * FUNCTION NAME: mayContain
+ *
+ * DESCRIPTION: Answers from memory only: the memtable and the SSTables' bloom filters
+ *
+ * RETURNS:
+ * false if the key is certainly absent
+ */
+bool LSMEngine::mayContain(string_view key) {
+	Memtable::iterator it = memtable.find(key);
+	if ( it != memtable.end() ) {
+		return !it->second.deleted;
+	}
+	lock_guard<mutex> guard(tablesLock);
+	for ( unsigned int i = 0; i < tables.size(); i++ ) {
+		if ( tables[i]->mayContain(key) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * FUNCTION NAME: mutate
+ *
+ * DESCRIPTION: Resolves the current value (memtable first, SSTables otherwise) and
+ * 				records the outcome in the memtable. Erasing a key that may still live
+ * 				in an SSTable leaves a tombstone. Flushes the memtable once it is full.
+ */
+void LSMEngine::mutate(string_view key, const Mutator &decide) {
+	Memtable::iterator it = memtable.find(key);
+	string onDisk;
+	string_view currentValue;
+	const string_view *current = NULL;
+	if ( it != memtable.end() ) {
+		if ( !it->second.deleted ) {
+			currentValue = it->second.value;
+			current = &currentValue;
+		}
+	}
+	else if ( searchTables(key, &onDisk) == KEY_FOUND ) {
+		currentValue = onDisk;
+		current = &currentValue;
+	}
+
+	string_view replacement;
+	MutateAction action = decide(current, &replacement);
+	if ( action == KEEP_VALUE || (action == ERASE_VALUE && current == NULL) ) {
+		return;
+	}
+
+	bool onlyMemtable;
+	{
+		lock_guard<mutex> guard(tablesLock);
+		onlyMemtable = tables.empty();
+	}
+	if ( it == memtable.end() ) {
+		if ( action == ERASE_VALUE && onlyMemtable ) {
+			return;
+		}
+		it = memtable.emplace(string(key), MemEntry()).first;
+		memtableBytes += key.size() + sizeof(Memtable::value_type);
+	}
+	memtableBytes -= it->second.value.size();
+	if ( action == STORE_VALUE ) {
+		it->second.value.assign(replacement.data(), replacement.size());
+		it->second.deleted = false;
+		memtableBytes += replacement.size();
+		if ( current == NULL ) {
+			liveKeys++;
+		}
+	}
+	else {
+		liveKeys--;
+		if ( onlyMemtable ) {
+			memtableBytes -= it->first.size() + sizeof(Memtable::value_type);
+			memtable.erase(it);
+			return;
+		}
+		it->second.value.clear();
+		it->second.deleted = true;
+	}
+
+	if ( memtableBytes >= memtableSize ) {
+		flush();
+	}
+}
+
+/**
+ * FUNCTION NAME: flush
+ *
+ * DESCRIPTION: Writes the memtable out as the newest SSTable and empties it, once the
+ * 				flush hook allowed it.
+ * 				On failure the memtable is kept and the flush is retried on a later write.
+ */
+void LSMEngine::flush() {
+	if ( memtable.empty() || (beforeFlush && beforeFlush() == FAILURE) ) {
+		return;
+	}
+	bool dropDeleted;
+	{
+		lock_guard<mutex> guard(tablesLock);
+		dropDeleted = tables.empty();
+	}
+
+	uint64_t seq = nextSeq, written;
+	MemSource<Memtable> source(memtable);
+	if ( SSTable::write(tablePath(seq, seq), &source, memtable.size(), dropDeleted, &written) == FAILURE ) {
+		return;
+	}
+	nextSeq++;
+	if ( written > 0 ) {
+		shared_ptr<SSTable> table(new SSTable(tablePath(seq, seq), seq, seq));
+		if ( table->open() != SUCCESS ) {
+			unlink(tablePath(seq, seq).c_str());
+			return;
+		}
+		lock_guard<mutex> guard(tablesLock);
+		tables.insert(tables.begin(), table);
+	}
+	memtable.clear();
+	memtableBytes = 0;
+
+	startCompaction();
+}
+
+/**
+ * FUNCTION NAME: startCompaction
+ *
+ * DESCRIPTION: Hands all current SSTables to a background compaction once there are
+ * 				COMPACTION_TRIGGER of them and no compaction is running
+ */
+void LSMEngine::startCompaction() {
+	vector<shared_ptr<SSTable> > inputs;
+	{
+		lock_guard<mutex> guard(tablesLock);
+		if ( tables.size() < COMPACTION_TRIGGER || (compaction.joinable() && !compactionDone) ) {
+			return;
+		}
+		inputs = tables;
+	}
+	waitCompaction();
+	compactionDone = false;
+	compaction = thread(&LSMEngine::compact, this, inputs);
+}
+
+/**
+ * FUNCTION NAME: waitCompaction
+ *
+ * DESCRIPTION: Blocks until the running compaction, if any, is finished
+ */
+void LSMEngine::waitCompaction() {
+	if ( compaction.joinable() ) {
+		compaction.join();
+	}
+}
+
+/**
+ * FUNCTION NAME: compact
+ *
+ * DESCRIPTION: Runs on the compaction thread. Merges inputs, the oldest SSTables,
+ * 				into one table; as nothing older remains, tombstones are dropped.
+ * 				Readers keep using the inputs until the merged table is swapped in.
+ */
+void LSMEngine::compact(vector<shared_ptr<SSTable> > inputs) {
+	uint64_t firstSeq = inputs.back()->getFirstSeq(), lastSeq = inputs.front()->getLastSeq();
+	uint64_t expected = 0;
+	vector<EntrySource *> sources;
+	for ( unsigned int i = 0; i < inputs.size(); i++ ) {
+		sources.push_back(inputs[i]->newIterator());
+		expected += inputs[i]->getEntries();
+	}
+	MergeSource merged(sources);
+	string path = tablePath(firstSeq, lastSeq);
+	uint64_t written;
+	bool ok = SSTable::write(path, &merged, expected, true, &written) == SUCCESS;
+
+	shared_ptr<SSTable> output;
+	if ( ok && written > 0 ) {
+		output.reset(new SSTable(path, firstSeq, lastSeq));
+		ok = output->open() == SUCCESS;
+	}
+
+	lock_guard<mutex> guard(tablesLock);
+	if ( ok ) {
+		// flushes done meanwhile only added tables in front of the inputs
+		tables.resize(tables.size() - inputs.size());
+		if ( output ) {
+			tables.push_back(output);
+		}
+		for ( unsigned int i = 0; i < inputs.size(); i++ ) {
+			unlink(inputs[i]->getPath().c_str());
+		}
+	}
+	compactionDone = true;
+}
+
+unsigned long LSMEngine::size() {
+	return liveKeys;
+}
+
+/**
+ * FUNCTION NAME: sync
+ *
+ * DESCRIPTION: Flushes the memtable, so that every mutation so far is in an SSTable
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int LSMEngine::sync() {
+	flush();
+	return memtable.empty() ? SUCCESS : FAILURE;
+}
+
+/**
+ * FUNCTION NAME: setFlushHook
+ *
+ * DESCRIPTION: Sets what to run before each flush
+ */
+void LSMEngine::setFlushHook(const function<int()> &beforeWrite) {
+	beforeFlush = beforeWrite;
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Drops the memtable and deletes every SSTable
+ */
+void LSMEngine::clear() {
+	waitCompaction();
+	lock_guard<mutex> guard(tablesLock);
+	for ( unsigned int i = 0; i < tables.size(); i++ ) {
+		unlink(tables[i]->getPath().c_str());
+	}
+	tables.clear();
+	memtable.clear();
+	memtableBytes = 0;
+	liveKeys = 0;
+}
+
+/**
+ * FUNCTION NAME: scan
+ *
+ * DESCRIPTION: Visits every live pair in key order, merging the memtable and the SSTables
+ */
+void LSMEngine::scan(const function<void(string_view, string_view)> &visit) {
+	vector<shared_ptr<SSTable> > snapshot;
+	{
+		lock_guard<mutex> guard(tablesLock);
+		snapshot = tables;
+	}
+	vector<EntrySource *> sources;
+	sources.push_back(new MemSource<Memtable>(memtable));
+	for ( unsigned int i = 0; i < snapshot.size(); i++ ) {
+		sources.push_back(snapshot[i]->newIterator());
+	}
+	for ( MergeSource merged(sources); merged.valid(); merged.next() ) {
+		if ( !merged.deleted() ) {
+			visit(merged.key(), merged.value());
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: getStats
+ *
+ * DESCRIPTION: Memory held by the memtable and by the SSTables' indexes and bloom filters.
+ * 				The SSTable data itself stays on disk.
+ */
+ArenaStats LSMEngine::getStats() {
+	ArenaStats stats;
+	stats.bytesUsed = memtableBytes;
+	lock_guard<mutex> guard(tablesLock);
+	for ( unsigned int i = 0; i < tables.size(); i++ ) {
+		stats.bytesUsed += tables[i]->memoryBytes();
+	}
+	stats.bytesReserved = stats.bytesUsed;
+	return stats;
+}
@@ -0,0 +1,77 @@
+/**********************************
+ * FILE NAME: LSMEngine.h
+ *
+ * DESCRIPTION: Header file of the log-structured merge tree backend
+ **********************************/
+
+#ifndef LSMENGINE_H_
+#define LSMENGINE_H_
+
+/**
+ * Header files
+ */
+#include "StorageEngine.h"
+#include "SSTable.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * Macros
+ */
+// a compaction starts once this many SSTables are live
+#define COMPACTION_TRIGGER 4
+
+/**
+ * CLASS NAME: LSMEngine
+ *
+ * DESCRIPTION: Backend for data sets larger than RAM. Writes go to a sorted in-memory
+ * 				memtable, which is written out as an immutable SSTable once it holds
+ * 				memtableSize bytes. Deletes leave tombstones until a compaction, run on a
+ * 				background thread, merges all SSTables into one.
+ * 				Files are named sst_<first seq>_<last seq>.sst after the flushes they cover.
+ */
+class LSMEngine : public StorageEngine {
+private:
+	class MemEntry {
+	public:
+		string value;
+		bool deleted;
+	};
+	typedef map<string, MemEntry, less<> > Memtable;
+	string dir;
+	unsigned long memtableSize;
+	Memtable memtable;
+	unsigned long memtableBytes;
+	unsigned long liveKeys;
+	uint64_t nextSeq;
+	// newest first; guarded by tablesLock, swapped by the compaction
+	vector<shared_ptr<SSTable> > tables;
+	mutex tablesLock;
+	thread compaction;
+	// set by the compaction thread once it is done
+	bool compactionDone;
+	// run before each flush, see setFlushHook
+	function<int()> beforeFlush;
+	string tablePath(uint64_t firstSeq, uint64_t lastSeq);
+	void load();
+	lookupRESULT searchTables(string_view key, string *value);
+	void flush();
+	void startCompaction();
+	void waitCompaction();
+	void compact(vector<shared_ptr<SSTable> > inputs);
+public:
+	LSMEngine(string dir, unsigned long memtableSize);
+	bool find(string_view key, string *value);
+	void mutate(string_view key, const Mutator &decide);
+	bool mayContain(string_view key);
+	unsigned long size();
+	void clear();
+	void scan(const function<void(string_view, string_view)> &visit);
+	int sync();
+	void setFlushHook(const function<int()> &beforeWrite);
+	ArenaStats getStats();
+	virtual ~LSMEngine();
+};
+
+#endif /* LSMENGINE_H_ */
@@ -0,0 +1,164 @@
+/**********************************
+ * FILE NAME: LZCodec.cpp
+ *
+ * DESCRIPTION: Definition of the LZ compression of stored values
+ **********************************/
+
+#include "LZCodec.h"
+#include "Coding.h"
+
+/**
+ * FUNCTION NAME: putLength
+ *
+ * DESCRIPTION: Appends the part of a length that did not fit its 4 bit token field:
+ * 				bytes of 255 then the remainder
+ */
+void LZCodec::putLength(string &out, size_t length) {
+	while ( length >= 255 ) {
+		out.push_back((char)255);
+		length -= 255;
+	}
+	out.push_back((char)length);
+}
+
+/**
+ * FUNCTION NAME: compress
+ *
+ * DESCRIPTION: Replaces out with the compressed block of in
+ */
+void LZCodec::compress(string_view in, string *out) {
+	const unsigned char *src = (const unsigned char *)in.data();
+	size_t size = in.size();
+	// the positions, plus one, of the last sequences seen per hash; small inputs get a small table
+	int hashBits = 8;
+	while ( hashBits < LZ_HASH_BITS && ((size_t)1 << hashBits) < size ) {
+		hashBits++;
+	}
+	vector<uint32_t> table((size_t)1 << hashBits, 0);
+	size_t anchor = 0, pos = 0;
+
+	out->clear();
+	out->reserve(4 + size + size / 255 + 16);
+	putU32(*out, (uint32_t)size);
+
+	auto emit = [&](size_t literals, size_t offset, size_t matchLength) {
+		size_t extra = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+		out->push_back((char)((min(literals, (size_t)15) << 4) | min(extra, (size_t)15)));
+		if ( literals >= 15 ) {
+			putLength(*out, literals - 15);
+		}
+		out->append((const char *)src + anchor, literals);
+		if ( matchLength == 0 ) {
+			return;
+		}
+		out->push_back((char)(offset & 0xFF));
+		out->push_back((char)(offset >> 8));
+		if ( extra >= 15 ) {
+			putLength(*out, extra - 15);
+		}
+	};
+
+	if ( size > LZ_LAST_LITERALS + LZ_MIN_MATCH ) {
+		size_t limit = size - LZ_LAST_LITERALS;
+		while ( pos + LZ_MIN_MATCH <= limit ) {
+			uint32_t sequence;
+			memcpy(&sequence, src + pos, 4);
+			uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+			size_t candidate = table[hash];
+			table[hash] = (uint32_t)pos + 1;
+			if ( candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET || memcmp(src + candidate - 1, src + pos, 4) != 0 ) {
+				pos++;
+				continue;
+			}
+			candidate--;
+			size_t length = LZ_MIN_MATCH;
+			while ( pos + length < limit && src[candidate + length] == src[pos + length] ) {
+				length++;
+			}
+			emit(pos - anchor, pos - candidate, length);
+			pos += length;
+			anchor = pos;
+		}
+	}
+	emit(size - anchor, 0, 0);
+}
+
+/**
+ * FUNCTION NAME: decompress
+ *
+ * DESCRIPTION: Replaces out with the data of a compressed block
+ *
+ * RETURNS:
+ * true on SUCCESS
+ * false if in is not a valid block
+ */
+bool LZCodec::decompress(string_view in, string *out) {
+	if ( in.size() < 4 ) {
+		return false;
+	}
+	const unsigned char *src = (const unsigned char *)in.data();
+	size_t end = in.size(), pos = 4;
+	size_t size = getU32(in.data());
+
+	auto getLength = [&](size_t *length) {
+		unsigned char byte;
+		do {
+			if ( pos >= end ) {
+				return false;
+			}
+			byte = src[pos++];
+			*length += byte;
+		} while ( byte == 255 );
+		return true;
+	};
+
+	// no input byte yields more than 255 output bytes (a length byte of 255): a larger
+	// size is a corrupt header, rejected before it is reserved
+	if ( size > (end - 4) * 255 ) {
+		return false;
+	}
+	out->clear();
+	out->reserve(size);
+	while ( pos < end ) {
+		unsigned char token = src[pos++];
+		size_t literals = token >> 4;
+		if ( literals == 15 && !getLength(&literals) ) {
+			return false;
+		}
+		if ( literals > end - pos || out->size() + literals > size ) {
+			return false;
+		}
+		out->append((const char *)src + pos, literals);
+		pos += literals;
+		if ( pos == end ) {
+			break;
+		}
+
+		if ( end - pos < 2 ) {
+			return false;
+		}
+		size_t offset = src[pos] | (src[pos + 1] << 8);
+		pos += 2;
+		size_t length = token & 15;
+		if ( length == 15 && !getLength(&length) ) {
+			return false;
+		}
+		length += LZ_MIN_MATCH;
+		if ( offset == 0 || offset > out->size() || out->size() + length > size ) {
+			return false;
+		}
+		size_t at = out->size();
+		out->resize(at + length);
+		char *data = &(*out)[0];
+		if ( offset >= length ) {
+			memcpy(data + at, data + at - offset, length);
+		}
+		else {
+			// the match overlaps the bytes it produces
+			for ( size_t i = 0; i < length; i++ ) {
+				data[at + i] = data[at - offset + i];
+			}
+		}
+	}
+	return out->size() == size;
+}
@@ -0,0 +1,45 @@
+/**********************************
+ * FILE NAME: LZCodec.h
+ *
+ * DESCRIPTION: Header file of the LZ compression of stored values
+ **********************************/
+
+#ifndef LZCODEC_H_
+#define LZCODEC_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+#include <string_view>
+
+/*
+ * Macros
+ */
+// shortest match worth encoding
+#define LZ_MIN_MATCH 4
+// farthest back a match may start (16 bit offsets)
+#define LZ_MAX_OFFSET 65535
+// the input always ends with this many literals
+#define LZ_LAST_LITERALS 5
+#define LZ_HASH_BITS 12
+
+/**
+ * CLASS NAME: LZCodec
+ *
+ * DESCRIPTION: Byte oriented LZ77 compressor in the LZ4 family: greedy matching through
+ * 				a hash table of 4 byte sequences, no entropy coding, so both directions
+ * 				run at memory speed. A block is [u32 raw size] followed by sequences of
+ * 				[token][literal length+][literals][u16 offset][match length+], the token
+ * 				holding 4 bits of each length; the last sequence has literals only.
+ */
+class LZCodec {
+private:
+	static void putLength(string &out, size_t length);
+public:
+	static void compress(string_view in, string *out);
+	static bool decompress(string_view in, string *out);
+};
+
+#endif /* LZCODEC_H_ */
@@ -9,7 +9,7 @@
  * You can add new members to the class if you think it
  * is necessary for your logic to work
  */
-MP1Node::MP1Node(Member *member, Params *params, EmulNet *emul, Log *log, Address *address) {
+MP1Node::MP1Node(Member *member, Params *params, Network *emul, Log *log, Address *address) {
     for( int i = 0; i < 6; i++ ) {
         NULLADDR[i] = 0;
     }
@@ -12,7 +12,7 @@
 #include "Log.h"
 #include "Params.h"
 #include "Member.h"
-#include "EmulNet.h"
+#include "Network.h"
 #include "Queue.h"
 
 /**
@@ -49,14 +49,14 @@ typedef struct MessageHdr {
  */
 class MP1Node {
 private:
-    EmulNet *emulNet;
+    Network *emulNet;
     Log *log;
     Params *par;
     Member *memberNode;
     char NULLADDR[6];
     
 public:
-    MP1Node(Member *, Params *, EmulNet *, Log *, Address *);
+    MP1Node(Member *, Params *, Network *, Log *, Address *);
     Member * getMemberNode() {
         return memberNode;
     }
@@ -5,28 +5,334 @@
  **********************************/
 #include "MP2Node.h"
 
+/**
+ * FUNCTION NAME: hasNode
+ *
+ * DESCRIPTION: Returns true if addr is one of nodes
+ */
+static bool hasNode(vector<Node> &nodes, Address *addr) {
+    for(auto &node : nodes)
+        if(*node.getAddress() == *addr)
+            return true;
+    return false;
+}
+
+/**
+ * FUNCTION NAME: bodySize
+ *
+ * DESCRIPTION: Returns the size of the frame of msg after its size prefix
+ */
+static size_t bodySize(Message_ &msg) {
+    return MESSAGE_HEADER + varintLength((uint32_t)msg.transID) + varintLength(msg.timestamp) + varintLength(msg.expiry)
+        + varintLength(msg.key.size()) + msg.key.size() + varintLength(msg.value.size()) + msg.value.size();
+}
+
+/**
+ * FUNCTION NAME: frameSize
+ *
+ * DESCRIPTION: Returns the size of the frame of the message
+ */
+size_t Message_::frameSize() {
+    size_t body = bodySize(*this);
+    
+    return varintLength(body) + body;
+}
+
+/**
+ * FUNCTION NAME: encodeInto
+ *
+ * DESCRIPTION: Writes the frame of the message into buffer: [varint32 size] then the body,
+ * 				the MESSAGE_HEADER bytes, [varint32 transID][varint64 timestamp]
+ * 				[varint32 expiry] and the key and value as [varint32 size][bytes]
+ *
+ * RETURNS:
+ * size of the frame
+ * 0 if it does not fit the capacity bytes of buffer
+ */
+size_t Message_::encodeInto(char *buffer, size_t capacity) {
+    size_t body = bodySize(*this);
+    if(varintLength(body) + body > capacity)
+        return 0;
+    
+    char *p = encodeVarint64(buffer, body);
+    *p++ = (char)(MESSAGE_MAGIC & 0xFF);
+    *p++ = (char)(MESSAGE_MAGIC >> 8);
+    *p++ = (char)MESSAGE_VERSION;
+    *p++ = (char)type;
+    *p++ = (char)flags;
+    *p++ = (char)request;
+    *p++ = (char)(replica | (success ? 4 : 0));
+    *p++ = 0;
+    memcpy(p, fromAddr.addr, sizeof(fromAddr.addr));
+    p += sizeof(fromAddr.addr);
+    p = encodeVarint64(p, (uint32_t)transID);
+    p = encodeVarint64(p, timestamp);
+    p = encodeVarint64(p, expiry);
+    p = encodeLengthPrefixed(p, key);
+    p = encodeLengthPrefixed(p, value);
+    return p - buffer;
+}
+
+/**
+ * FUNCTION NAME: encode
+ *
+ * DESCRIPTION: Appends the frame of the message to out
+ */
+void Message_::encode(string &out) {
+    size_t start = out.size();
+    
+    out.resize(start + frameSize());
+    encodeInto(&out[start], out.size() - start);
+}
+
+/**
+ * FUNCTION NAME: decode
+ *
+ * DESCRIPTION: Decodes the frame at the start of bytes without copying: key and value
+ * 				point into bytes, which must outlive this view.
+ * 				For a mixed version cluster: a frame of a newer version may end with fields
+ * 				this version does not know, which are skipped, and may carry a type it does
+ * 				not know, which is kept for the dispatcher to ignore.
+ *
+ * RETURNS:
+ * size of the frame
+ * 0 if bytes do not start with a complete, valid frame
+ */
+size_t MessageView::decode(string_view bytes) {
+    const char *p = bytes.data(), *limit = bytes.data() + bytes.size();
+    uint32_t size, id;
+    
+    p = getVarint32(p, limit, &size);
+    if(p == NULL || size > (size_t)(limit - p) || size < MESSAGE_HEADER)
+        return 0;
+    limit = p + size;
+    
+    unsigned int magic = (unsigned char)p[0] | ((unsigned char)p[1] << 8);
+    version = (uint8_t)p[2];
+    if(magic != MESSAGE_MAGIC || version == 0 || (p[6] & 3) > TERTIARY)
+        return 0;
+    type = (MessageType_)p[3];
+    flags = (uint8_t)p[4];
+    request = (MessageType_)p[5];
+    replica = (ReplicaType)(p[6] & 3);
+    success = (p[6] & 4) != 0;
+    memcpy(fromAddr.addr, p + MESSAGE_ENVELOPE, sizeof(fromAddr.addr));
+    p += MESSAGE_HEADER;
+    
+    p = getVarint32(p, limit, &id);
+    p = p ? getVarint64(p, limit, &timestamp) : NULL;
+    p = p ? getVarint32(p, limit, &expiry) : NULL;
+    p = p ? getLengthPrefixed(p, limit, &key) : NULL;
+    p = p ? getLengthPrefixed(p, limit, &value) : NULL;
+    if(p == NULL || (p != limit && version <= MESSAGE_VERSION))
+        return 0;
+    
+    transID = (int)id;
+    return limit - bytes.data();
+}
+
 /**
  * constructor
  */
-MP2Node::MP2Node(Member *memberNode, Params *par, EmulNet * emulNet, Log * log, Address * address) {
+MP2Node::MP2Node(Member *memberNode, Params *par, Network * emulNet, Log * log, Address * address) {
     this->memberNode = memberNode;
     this->par = par;
     this->emulNet = emulNet;
     this->log = log;
-    ht = new HashTable();
     this->memberNode->addr = *address;
+    ht = new HashTable(par, dataFile("lsm"));
     
     leader=false;
+    
+    // before the restore, which moves the clock past the timestamps of the restored records
+    int id;
+    memcpy(&id, &address->addr[0], sizeof(int));
+    clock = new HybridClock(par, (uint16_t)id);
+    expiries = new TimerWheel(par->getcurrtime());
+    
+    workers = par->WORKER_THREADS > 1 ? new WorkerPool(par->WORKER_THREADS) : NULL;
+    rowCache = par->ROW_CACHE_SIZE > 0 ? new RowCache(par->ROW_CACHE_SIZE) : NULL;
+    budget = new MemoryBudget(par->MEMORY_BUDGET);
+    messages = new ObjectPool<Message_>();
+    sendBuffer = new char[par->MAX_MSG_SIZE];
+    batchLimit = emulNet->ENmaxPayload();
+    overBudget = false;
+    
+    restoring = NULL;
+    restoreCursor = 0;
+    lastSnapshot = 0;
+    lastPurge = 0;
+    if(par->SNAPSHOT)
+        restoreSnapshot();
+    
+    commitLog = NULL;
+    if(par->COMMITLOG)
+        replayCommitLog();
 }
 
 /**
  * Destructor
  */
 MP2Node::~MP2Node() {
+    delete workers;
+    delete clock;
+    delete expiries;
+    delete rowCache;
+    delete budget;
+    delete messages;
+    delete[] sendBuffer;
+    delete restoring;
+    delete commitLog;
     delete ht;
     delete memberNode;
 }
 
+/**
+ * FUNCTION NAME: dataFile
+ *
+ * DESCRIPTION: Returns the path of one of this node's durable files
+ */
+string MP2Node::dataFile(string name) {
+    string id = memberNode->addr.getAddress();
+    replace(id.begin(), id.end(), ':', '_');
+    
+    return string(par->DATA_DIR) + "/" + name + "_" + id;
+}
+
+/**
+ * FUNCTION NAME: restoreSnapshot
+ *
+ * DESCRIPTION: Maps this node's snapshot, if there is one. Reads are served from it
+ * 				right away while restoreStep copies it into the hash table a batch per tick.
+ * 				The clock observes the newest timestamp of the snapshot, kept in its header,
+ * 				first: after a restart it starts over from the current time, behind the
+ * 				records, and the writes this node coordinates would otherwise lose to them
+ * 				as stale.
+ */
+void MP2Node::restoreSnapshot() {
+    Snapshot *snapshot = new Snapshot(dataFile("snapshot") + ".snap");
+    
+    if(snapshot->open() == FAILURE || snapshot->size() == 0)
+    {
+        delete snapshot;
+        return;
+    }
+    
+    clock->observe(snapshot->newestTimestamp());
+    restoring = snapshot;
+    log->LOG(&memberNode->addr, "Serving %lu keys from snapshot while rebuilding", (unsigned long)snapshot->size());
+}
+
+/**
+ * FUNCTION NAME: restoreStep
+ *
+ * DESCRIPTION: Copies the next count snapshot entries into the hash table.
+ * 				Keys written or deleted since the restart keep their newer record.
+ * 				The snapshot is released once fully copied.
+ */
+void MP2Node::restoreStep(uint64_t count) {
+    string_view key, value;
+    
+    for(uint64_t n = 0; n < count && restoreCursor < restoring->size(); n++, restoreCursor++)
+    {
+        if(!restoring->entry(restoreCursor, &key, &value))
+            continue;
+        
+        // a record written since the restart, tombstones included, is newer and wins
+        ht->putIfNewer(key, value, false);
+        scheduleExpiry(key, value);
+    }
+    
+    if(restoreCursor < restoring->size())
+        return;
+    
+    log->LOG(&memberNode->addr, "Rebuilt hash table from snapshot, %lu keys", ht->currentSize());
+    delete restoring;
+    restoring = NULL;
+}
+
+/**
+ * FUNCTION NAME: promoteKey
+ *
+ * DESCRIPTION: While restoring, copies the key from the snapshot into the hash table
+ * 				before it is mutated, so the mutation sees its current value
+ */
+void MP2Node::promoteKey(string_view key) {
+    string value;
+    
+    if(!restoring || ht->count(key))
+        return;
+    
+    if(restoring->get(key, &value))
+        ht->insertIfAbsent(key, value);
+}
+
+/**
+ * FUNCTION NAME: takeSnapshot
+ *
+ * DESCRIPTION: Writes the whole hash table to this node's snapshot. Once the snapshot
+ * 				is durable the commit log records it covers are dropped.
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int MP2Node::takeSnapshot() {
+    if(restoring)
+        restoreStep(restoring->size());
+    
+    if(Snapshot::write(dataFile("snapshot") + ".snap", ht) == FAILURE)
+    {
+        log->LOG(&memberNode->addr, "Snapshot write failed");
+        return FAILURE;
+    }
+    lastSnapshot = par->getcurrtime();
+    
+    if(commitLog && commitLog->truncate() == FAILURE)
+        log->LOG(&memberNode->addr, "Commit log truncation failed");
+    
+    log->LOG(&memberNode->addr, "Snapshot of %lu keys written", ht->currentSize());
+    return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: replayCommitLog
+ *
+ * DESCRIPTION: Rebuilds the hash table from this node's commit log, then keeps the log
+ * 				open so that every later mutation is written through it
+ */
+void MP2Node::replayCommitLog() {
+    commitLog = new CommitLog(dataFile("commitlog") + ".log", par->COMMITLOG_SYNC, par->COMMITLOG_PERIOD);
+    
+    int replayed = commitLog->replay([this](LogOp op, const string &key, const string &value)
+    {
+        // the log holds the mutations made after the snapshot
+        promoteKey(key);
+        // so that new writes are timestamped after the replayed ones
+        clock->observe(Record::timestampOf(value));
+        
+        // values are encoded records, so replaying is last-write-wins too
+        if(op == LOG_CREATE)
+            ht->putIfNewer(key, value, false);
+        else if(op == LOG_UPDATE)
+            ht->putIfNewer(key, value, true, par->getcurrtime());
+        else if(op == LOG_DELETE)
+            ht->deleteIfNewer(key, Record::timestampOf(value), par->getcurrtime());
+        
+        if(op != LOG_DELETE)
+            scheduleExpiry(key, value);
+    });
+    
+    if(commitLog->open() == FAILURE)
+    {
+        log->LOG(&memberNode->addr, "Could not open commit log, mutations are not durable");
+        delete commitLog;
+        commitLog = NULL;
+        return;
+    }
+    
+    log->LOG(&memberNode->addr, "Replayed %d commit log records, %lu keys", replayed, ht->currentSize());
+}
+
 /**
  * FUNCTION NAME: updateRing
  *
@@ -50,8 +356,9 @@ void MP2Node::updateRing() {
     
     if( ring.size()!=curMemList.size())
     {
+        vector<Node> oldRing = ring;
         ring=curMemList;
-        stabilizationProtocol(curMemList);
+        stabilizationProtocol(oldRing);
     }
 
 }
@@ -86,13 +393,13 @@ vector<Node> MP2Node::getMembershipList() {
  * DESCRIPTION: This functions hashes the key and returns the position on the ring
  * 				HASH FUNCTION USED FOR CONSISTENT HASHING
  *
+ * 				It is the token the hash table can order keys by
+ *
  * RETURNS:
  * size_t position on the ring
  */
 size_t MP2Node::hashFunction(string key) {
-    std::hash<string> hashFunc;
-    size_t ret = hashFunc(key);
-    return ret%RING_SIZE;
+    return HashTable::token(key);
 }
 
 /**
@@ -103,17 +410,35 @@ size_t MP2Node::hashFunction(string key) {
  * 				1) Constructs the message
  * 				2) Finds the replicas of this key
  * 				3) Sends a message to the replica
+ * 				With a ttl the key expires ttl time units from now.
+ * 				Over its memory budget, or when the message is too large for a datagram,
+ * 				the node fails the create without sending it.
  */
 
-void MP2Node::clientCreate(string key, string value) {
+void MP2Node::clientCreate(string key, string value, int ttl) {
+    
+    if(overBudget)
+    {
+        log->logCreateFail(&memberNode->addr, true, ++g_transID, key, value);
+        return;
+    }
     
     vector<Node> replicas=findNodes(key);
     
-    Message_ *msg = new Message_(++g_transID,memberNode->addr,CREATE_,key,value);
-    TransID[g_transID]=0;
+    Message_ *msg = messages->acquire();
+    msg->assign(++g_transID,memberNode->addr,CREATE_,key,value);
+    msg->timestamp = clock->now();
+    msg->expiry = ttl > 0 ? par->getcurrtime() + ttl : 0;
+    openTransaction(g_transID, CREATE_, key, value);
+    if(msg->frameSize() > batchLimit)
+    {
+        failTransaction(msg->transID);
+        messages->release(msg);
+        return;
+    }
     
-    for(auto replica : replicas)
-        emulNet->ENsend(&memberNode->addr,replica.getAddress(),(char *)msg,sizeof(Message_));
+    sendMessage(replicas, msg);
+    messages->release(msg);
 }
 
 /**
@@ -124,16 +449,24 @@ void MP2Node::clientCreate(string key, string value) {
  * 				1) Constructs the message
  * 				2) Finds the replicas of this key
  * 				3) Sends a message to the replica
+ * 				A key too large for a datagram fails the read without sending it.
  */
 void MP2Node::clientRead(string key){
 
-    Message_ *msg = new Message_(++g_transID,memberNode->addr,READ_,key);
-    TransID[msg->transID]=0;
+    Message_ *msg = messages->acquire();
+    msg->assign(++g_transID,memberNode->addr,READ_,key);
+    openTransaction(msg->transID, READ_, key);
+    if(msg->frameSize() > batchLimit)
+    {
+        failTransaction(msg->transID);
+        messages->release(msg);
+        return;
+    }
     leader=true;
     
     vector<Node> replicas=findNodes(key);
-    for(auto nodes : replicas)
-        emulNet->ENsend(&memberNode->addr,nodes.getAddress() ,(char *)msg,sizeof(Message_));
+    sendMessage(replicas, msg);
+    messages->release(msg);
 }
 
 /**
@@ -144,16 +477,34 @@ void MP2Node::clientRead(string key){
  * 				1) Constructs the message
  * 				2) Finds the replicas of this key
  * 				3) Sends a message to the replica
+ * 				With a ttl the key expires ttl time units from now, otherwise never.
+ * 				Over its memory budget, or when the message is too large for a datagram,
+ * 				the node fails the update without sending it.
  */
-void MP2Node::clientUpdate(string key, string value){
+void MP2Node::clientUpdate(string key, string value, int ttl){
+    
+    if(overBudget)
+    {
+        log->logUpdateFail(&memberNode->addr, true, ++g_transID, key, value);
+        return;
+    }
     
-    Message_ *msg = new Message_(++g_transID,memberNode->addr,UPDATE_,key,value);
-    TransID[msg->transID]=0;
+    Message_ *msg = messages->acquire();
+    msg->assign(++g_transID,memberNode->addr,UPDATE_,key,value);
+    msg->timestamp = clock->now();
+    msg->expiry = ttl > 0 ? par->getcurrtime() + ttl : 0;
+    openTransaction(msg->transID, UPDATE_, key, value);
+    if(msg->frameSize() > batchLimit)
+    {
+        failTransaction(msg->transID);
+        messages->release(msg);
+        return;
+    }
     leader=true;
     
     vector<Node> replicas=findNodes(key);
-    for(auto nodes : replicas)
-        emulNet->ENsend(&memberNode->addr,nodes.getAddress() ,(char *)msg,sizeof(Message_));
+    sendMessage(replicas, msg);
+    messages->release(msg);
     
 }
 
@@ -165,18 +516,101 @@ void MP2Node::clientUpdate(string key, string value){
  * 				1) Constructs the message
  * 				2) Finds the replicas of this key
  * 				3) Sends a message to the replica
+ * 				A key too large for a datagram fails the delete without sending it.
  */
 
 void MP2Node::clientDelete(string key){
 
-    Message_ *msg = new Message_(++g_transID,memberNode->addr,DELETE_,key);
-    TransID[msg->transID]=0;
+    Message_ *msg = messages->acquire();
+    msg->assign(++g_transID,memberNode->addr,DELETE_,key);
+    msg->timestamp = clock->now();
+    openTransaction(msg->transID, DELETE_, key);
+    if(msg->frameSize() > batchLimit)
+    {
+        failTransaction(msg->transID);
+        messages->release(msg);
+        return;
+    }
     
     vector<Node> replicas=findNodes(key);
     
     
-    for(auto nodes : replicas)
-        emulNet->ENsend(&memberNode->addr,nodes.getAddress() ,(char *)msg,sizeof(Message_));
+    sendMessage(replicas, msg);
+    messages->release(msg);
+}
+
+/**
+ * FUNCTION NAME: sendMessage
+ *
+ * DESCRIPTION: Encodes the message once into sendBuffer and queues the frame for every node
+ * 				of targets. A message too large for a datagram could not be delivered
+ * 				and is dropped, which is logged.
+ */
+void MP2Node::sendMessage(vector<Node> &targets, Message_ *msg) {
+    size_t size = msg->encodeInto(sendBuffer, batchLimit);
+    
+    if(size == 0)
+    {
+        log->LOG(&memberNode->addr, "Dropped message %d of %lu bytes, too large to send", msg->transID, (unsigned long)msg->frameSize());
+        return;
+    }
+    for(auto &node : targets)
+        queueFrame(node.getAddress(), sendBuffer, size);
+}
+
+/**
+ * FUNCTION NAME: sendMessage
+ *
+ * DESCRIPTION: Same for a single destination
+ */
+void MP2Node::sendMessage(Address *to, Message_ *msg) {
+    size_t size = msg->encodeInto(sendBuffer, batchLimit);
+    
+    if(size == 0)
+    {
+        log->LOG(&memberNode->addr, "Dropped message %d of %lu bytes, too large to send", msg->transID, (unsigned long)msg->frameSize());
+        return;
+    }
+    queueFrame(to, sendBuffer, size);
+}
+
+/**
+ * FUNCTION NAME: queueFrame
+ *
+ * DESCRIPTION: Appends the frame to the batch of its destination. Frames are length
+ * 				prefixed, so a batch is just their concatenation. A batch the frame
+ * 				would push over batchLimit is sent first.
+ */
+void MP2Node::queueFrame(Address *to, const char *frame, size_t size) {
+    pair<Address, string> &batch = outbound[string(to->addr, sizeof(to->addr))];
+    
+    if(batch.second.empty())
+        batch.first = *to;
+    else if(batch.second.size() + size > batchLimit)
+    {
+        emulNet->ENsend(&memberNode->addr, &batch.first, &batch.second[0], (int)batch.second.size());
+        batch.second.clear();
+    }
+    batch.second.append(frame, size);
+}
+
+/**
+ * FUNCTION NAME: flushOutbound
+ *
+ * DESCRIPTION: Sends each destination the frames queued for it since the last flush, in
+ * 				one datagram. Called once per tick, after the node has handled its messages
+ * 				and the client requests of the tick were issued.
+ */
+void MP2Node::flushOutbound() {
+    for(auto &entry : outbound)
+    {
+        pair<Address, string> &batch = entry.second;
+        if(batch.second.empty())
+            continue;
+        emulNet->ENsend(&memberNode->addr, &batch.first, &batch.second[0], (int)batch.second.size());
+        // keeps its capacity for the next tick
+        batch.second.clear();
+    }
 }
 
 /**
@@ -184,20 +618,20 @@ void MP2Node::clientDelete(string key){
  *
  * DESCRIPTION: Server side CREATE API
  * 			   	The function does the following:
- * 			   	1) Inserts key value into the local hash table
+ * 			   	1) Inserts key value into the local hash table, unless the key holds a newer write
  * 			   	2) Return true or false based on success or failure
+ * 			   	Creates are idempotent: a resent or superseded create still succeeds.
+ * 			   	*record is set to the encoded record, for the commit log.
+ * 			   	May run on a worker thread; completeServerOp logs the outcome
  */
-bool MP2Node::createKeyValue(string key, string value) {
-
-    if(ht->create(key, value)==false)
-        return false;
+bool MP2Node::createKeyValue(string_view key, string_view value, uint64_t timestamp, string *record, uint8_t flags, uint32_t expiry) {
     
-    log->logCreateSuccess(&memberNode->addr, false, g_transID, key, value);
+    promoteKey(key);
     
-
+    encodeValue(*record, timestamp, flags, value, expiry);
+    ht->putIfNewer(key, *record, false);
+    invalidateKey(key);
     return true;
-    
-    
 }
 
 /**
@@ -205,20 +639,47 @@ bool MP2Node::createKeyValue(string key, string value) {
  *
  * DESCRIPTION: Server side READ API
  * 			    This function does the following:
- * 			    1) Read key from local hash table
- * 			    2) Return value
+ * 			    1) Read key from the row cache, else from the local hash table unless it is
+ * 			       known to be absent, caching the record found
+ * 			    2) Return value, and its write timestamp in *timestamp
+ * 			    May run on a worker thread; completeServerOp logs the outcome
  */
-string MP2Node::readKey(string key) {
+string MP2Node::readKey(string_view key, uint64_t *timestamp) {
 
-    string read = this->ht->read(key);
+    string stored;
+    Record record;
+    bool cached = rowCache && rowCache->get(key, &stored);
     
-    if(read.empty())
-        log->logReadFail(&memberNode->addr, false, g_transID, key);
-    else
-        log->logReadSuccess(&memberNode->addr, false, g_transID, key, read);
-        
+    // a missing key is usually answered by the bloom filters alone, without disk access
+    if(!cached && ht->mayContain(key))
+        ht->get(key, &stored);
+    
+    // not copied into the hash table yet
+    if(!cached && stored.empty() && restoring)
+        restoring->get(key, &stored);
+    
+    if(!Record::decode(stored, &record))
+        return "";
+    
+    string value;
+    if(!record.unpack(&value))
+        return "";
+    
+    // cached decompressed; tombstones and expired values too, they read as absent below
+    if(rowCache && !cached)
+    {
+        string entry;
+        Record::encode(entry, record.timestamp, record.flags & ~RECORD_COMPRESSED, value, record.expiry);
+        rowCache->put(key, entry);
+    }
     
-    return read;
+    // a tombstone or an expired value reads as absent
+    if(!record.isLive(par->getcurrtime()))
+        return "";
+    
+    if(timestamp)
+        *timestamp = record.timestamp;
+    return value;
 }
 
 /**
@@ -226,19 +687,20 @@ string MP2Node::readKey(string key) {
  *
  * DESCRIPTION: Server side UPDATE API
  * 				This function does the following:
- * 				1) Update the key to the new value in the local hash table
+ * 				1) Update the key to the new value in the local hash table, last write wins
  * 				2) Return true or false based on success or failure
+ * 				An update older than the stored value succeeds without effect.
+ * 				*record is set to the encoded record, for the commit log.
+ * 				May run on a worker thread; completeServerOp logs the outcome
  */
-bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica) {
+bool MP2Node::updateKeyValue(string_view key, string_view value, ReplicaType replica, uint64_t timestamp, string *record, uint32_t expiry) {
     
-    if( this->ht->update(key, value) )
-    {
-        log->logUpdateSuccess(&memberNode->addr, false, g_transID, key, value);
-        return true;
-    }
-    log->logUpdateFail(&memberNode->addr, false, g_transID, key, value);
+    promoteKey(key);
     
-    return false;
+    encodeValue(*record, timestamp, 0, value, expiry);
+    writeRESULT result = this->ht->putIfNewer(key, *record, true, par->getcurrtime());
+    invalidateKey(key);
+    return result != WRITE_ABSENT;
 }
 
 /**
@@ -246,20 +708,273 @@ bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica) {
  *
  * DESCRIPTION: Server side DELETE API
  * 				This function does the following:
- * 				1) Delete the key from the local hash table
+ * 				1) Delete the key from the local hash table, unless it was written after the delete
  * 				2) Return true or false based on success or failure
+ * 				An absent key still gets a tombstone. *tombstone is set to the record
+ * 				stored, if any, for the commit log, and left empty otherwise.
+ * 				May run on a worker thread; completeServerOp logs the outcome
+ */
+bool MP2Node::deletekey(string_view key, uint64_t timestamp, string *tombstone) {
+    
+    promoteKey(key);
+    
+    writeRESULT result = this->ht->deleteIfNewer(key, timestamp, par->getcurrtime());
+    invalidateKey(key);
+    if(result != WRITE_STALE)
+        Record::encode(*tombstone, timestamp, RECORD_TOMBSTONE, "");
+    return result != WRITE_ABSENT;
+}
+
+/**
+ * FUNCTION NAME: executeServerOps
+ *
+ * DESCRIPTION: Applies the CRUD messages of one drain to the hash table.
+ * 				With worker threads, messages are split by shard, so each shard is
+ * 				served by a single worker and the messages of one key keep their order.
+ * 				While restoring from a snapshot everything runs on this thread.
+ */
+void MP2Node::executeServerOps(vector<ServerOp> &ops) {
+    if(!workers || restoring)
+    {
+        for(auto &op : ops)
+            executeServerOp(op);
+        return;
+    }
+    
+    int count = workers->size();
+    workers->run([this, &ops, count](int worker)
+    {
+        for(auto &op : ops)
+            if(isServerOp(op.msg.type) && (int)(ht->shardOf(op.msg.key) % count) == worker)
+                executeServerOp(op);
+    });
+}
+
+/**
+ * FUNCTION NAME: executeServerOp
+ *
+ * DESCRIPTION: Runs the server side API of one message, recording its outcome
  */
-bool MP2Node::deletekey(string key) {
+void MP2Node::executeServerOp(ServerOp &op) {
+    MessageView *msg = &op.msg;
     
-    if(this->ht->deleteKey(key))
+    if(op.rejected)
+        return;
+    
+    if(msg->type == CREATE_)
     {
-        log->logDeleteSuccess(&memberNode->addr, false, g_transID, key);
-        return true;
+        // stabilization ships values as stored, compressed or not
+        if((msg->flags & RECORD_COMPRESSED) && !LZCodec::decompress(msg->value, &op.read))
+        {
+            op.malformed = true;
+            return;
+        }
+        op.success = createKeyValue(msg->key, msg->value, msg->timestamp, &op.record, msg->flags, msg->expiry);
+    }
+    else if(msg->type == READ_)
+    {
+        op.read = readKey(msg->key, &op.timestamp);
+        op.success = !op.read.empty();
     }
+    else if(msg->type == UPDATE_)
+        op.success = updateKeyValue(msg->key, msg->value, PRIMARY, msg->timestamp, &op.record, msg->expiry);
+    else if(msg->type == DELETE_)
+        op.success = deletekey(msg->key, msg->timestamp, &op.record);
+}
+
+/**
+ * FUNCTION NAME: completeServerOp
+ *
+ * DESCRIPTION: Runs on the node's thread, in arrival order, once the message was applied:
+ * 				logs the outcome, appends the mutation to the commit log and queues the reply.
+ * 				A rejected write is answered with REJECTED_.
+ */
+void MP2Node::completeServerOp(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    Message_ *reply = NULL;
+    string key(msg->key);
     
-    log->logDeleteFail(&memberNode->addr, false, g_transID, key);
+    if(op.rejected)
+    {
+        // a tombstone streamed by stabilization: nobody awaits a reply
+        if(msg->flags & RECORD_TOMBSTONE)
+            return;
+        
+        if(msg->type == CREATE_)
+            log->logCreateFail(&memberNode->addr, false, g_transID, key, string(msg->value));
+        else
+            log->logUpdateFail(&memberNode->addr, false, g_transID, key, string(msg->value));
+        
+        reply = newReply(msg->transID,REJECTED_,msg->key,msg->value);
+        reply->request = msg->type;
+    }
+    else if(msg->type == CREATE_)
+    {
+        if(op.malformed)
+        {
+            log->LOG(&memberNode->addr, "Dropped a create of key %s whose value does not decompress", key.c_str());
+            return;
+        }
+        if(!op.success)
+            return;
+        
+        // a tombstone streamed by stabilization: stored quietly, nobody awaits a reply
+        if(msg->flags & RECORD_TOMBSTONE)
+        {
+            if(commitLog)
+                commitLog->append(LOG_DELETE, msg->key, op.record);
+            return;
+        }
+        
+        // the record the worker stored, already compressed
+        if(commitLog)
+            commitLog->append(LOG_CREATE, msg->key, op.record);
+        if(msg->expiry)
+            expiries->schedule(msg->key, msg->expiry);
+        
+        string value = (msg->flags & RECORD_COMPRESSED) ? op.read : string(msg->value);
+        
+        log->logCreateSuccess(&memberNode->addr, false, g_transID, key, value);
+        
+        reply = newReply(msg->transID,CREATEREPLY_,msg->key,value);
+    }
+    else if(msg->type == READ_)
+    {
+        if(op.success)
+            log->logReadSuccess(&memberNode->addr, false, g_transID, key, op.read);
+        else
+            log->logReadFail(&memberNode->addr, false, g_transID, key);
+        
+        reply = newReply(msg->transID,op.success ? READREPLY_ : READFAIL_,msg->key,op.read);
+        reply->timestamp = op.timestamp;
+    }
+    else if(msg->type == UPDATE_)
+    {
+        if(op.success)
+        {
+            if(commitLog)
+                commitLog->append(LOG_UPDATE, msg->key, op.record);
+            if(msg->expiry)
+                expiries->schedule(msg->key, msg->expiry);
+            
+            log->logUpdateSuccess(&memberNode->addr, false, g_transID, key, string(msg->value));
+        }
+        else
+            log->logUpdateFail(&memberNode->addr, false, g_transID, key, string(msg->value));
+        
+        reply = newReply(msg->transID,op.success ? UPDATEREPLY_ : UPDATEFAIL_,msg->key,msg->value);
+    }
+    else if(msg->type == DELETE_)
+    {
+        // the tombstone of an absent key is logged too, though the delete fails
+        if(commitLog && !op.record.empty())
+            commitLog->append(LOG_DELETE, msg->key, op.record);
+        
+        if(op.success)
+            log->logDeleteSuccess(&memberNode->addr, false, g_transID, key);
+        else
+            log->logDeleteFail(&memberNode->addr, false, g_transID, key);
+        
+        reply = newReply(msg->transID,op.success ? DELETEREPLY_ : DELETEFAIL_,msg->key,msg->value);
+    }
     
-    return false;
+    replies.emplace_back(msg->fromAddr, reply);
+}
+
+/**
+ * FUNCTION NAME: storageStats
+ *
+ * DESCRIPTION: Returns the bytes used versus the bytes reserved by this node's hash table
+ */
+ArenaStats MP2Node::storageStats() {
+    return ht->stats();
+}
+
+/**
+ * FUNCTION NAME: cacheStats
+ *
+ * DESCRIPTION: Returns the counters of this node's row cache, all 0 when disabled
+ */
+CacheStats MP2Node::cacheStats() {
+    return rowCache ? rowCache->stats() : CacheStats();
+}
+
+/**
+ * FUNCTION NAME: messageAllocations
+ *
+ * DESCRIPTION: Returns the number of Message_ objects this node allocated: it stops
+ * 				growing once the pool covers the most messages in flight at once
+ */
+unsigned long MP2Node::messageAllocations() {
+    return messages->getAllocations();
+}
+
+/**
+ * FUNCTION NAME: newReply
+ *
+ * DESCRIPTION: Returns a pooled reply of this node to the transaction transID
+ */
+Message_ *MP2Node::newReply(int transID, MessageType_ type, string_view key, string_view value) {
+    Message_ *reply = messages->acquire();
+    
+    reply->assign(transID, memberNode->addr, type, key, value);
+    return reply;
+}
+
+/**
+ * FUNCTION NAME: memoryStats
+ *
+ * DESCRIPTION: Returns the memory accounting of this node, as of its last drain
+ */
+MemoryBudget MP2Node::memoryStats() {
+    return *budget;
+}
+
+/**
+ * FUNCTION NAME: checkBudget
+ *
+ * DESCRIPTION: Measures the memory this node holds: storage, the queued bytes of the
+ * 				messages drained and the transactions it coordinates. Over MEMORY_BUDGET, the
+ * 				hash table is synced first, which moves LSM memtables to disk.
+ * 				Logs when the node goes over or back under its budget.
+ *
+ * RETURNS:
+ * true if the node is still over its budget: the writes of the drain are then rejected
+ */
+bool MP2Node::checkBudget(unsigned long queued) {
+    budget->set(MEMORY_QUEUE, queued);
+    
+    // only the transactions in flight: they are closed once decided or timed out
+    unsigned long pending = TransID.size() * PENDING_ENTRY_SIZE;
+    for(auto &read : newestRead)
+        pending += PENDING_ENTRY_SIZE + read.second.second.size();
+    budget->set(MEMORY_PENDING, pending);
+    
+    budget->set(MEMORY_STORAGE, ht->stats().bytesUsed + cacheStats().bytes);
+    if(budget->exceeded() && ht->sync() == SUCCESS)
+        budget->set(MEMORY_STORAGE, ht->stats().bytesUsed + cacheStats().bytes);
+    
+    bool exceeded = budget->exceeded();
+    if(exceeded && !overBudget)
+        log->LOG(&memberNode->addr, "Memory budget exceeded, %lu of %lu bytes: rejecting writes", budget->total(), budget->getLimit());
+    if(!exceeded && overBudget)
+        log->LOG(&memberNode->addr, "Back under memory budget, %lu of %lu bytes", budget->total(), budget->getLimit());
+    overBudget = exceeded;
+    return exceeded;
+}
+
+/**
+ * FUNCTION NAME: invalidateKey
+ *
+ * DESCRIPTION: Drops the key from the row cache after a write to it. The row cache is
+ * 				filled by readKey, which for a given key runs on the same thread as the
+ * 				writes, so a stale record cannot be cached after its invalidation.
+ * 				Purging a tombstone needs no invalidation, both read as absent, nor copying
+ * 				the snapshot in while restoring, as readKey already falls back to it.
+ */
+void MP2Node::invalidateKey(string_view key) {
+    if(rowCache)
+        rowCache->invalidate(key);
 }
 
 info MP2Node::NewEntry(int& TID, string& K, string& V, int& C, MessageType_& T)
@@ -270,133 +985,454 @@ info MP2Node::NewEntry(int& TID, string& K, string& V, int& C, MessageType_& T)
     return entry;
 }
 
+/**
+ * Handler of each message type, in the order of MessageType_
+ */
+const MP2Node::MessageHandler MP2Node::handlers[MESSAGE_TYPES] = {
+    &MP2Node::completeServerOp,     // CREATE_
+    &MP2Node::completeServerOp,     // READ_
+    &MP2Node::completeServerOp,     // UPDATE_
+    &MP2Node::completeServerOp,     // DELETE_
+    &MP2Node::handleUpdateReply,    // UPDATEREPLY_
+    &MP2Node::handleDeleteReply,    // DELETEREPLY_
+    &MP2Node::handleCreateReply,    // CREATEREPLY_
+    &MP2Node::handleReadReply,      // READREPLY_
+    &MP2Node::handleDeleteFail,     // DELETEFAIL_
+    &MP2Node::handleReadFail,       // READFAIL_
+    &MP2Node::handleUpdateFail,     // UPDATEFAIL_
+    &MP2Node::handleRejected,       // REJECTED_
+};
+
+/**
+ * FUNCTION NAME: openTransaction
+ *
+ * DESCRIPTION: Starts counting the replies of a transaction this node coordinates
+ */
+void MP2Node::openTransaction(int transID, MessageType_ type, const string &key, const string &value) {
+    Transaction &transaction = TransID[transID];
+    transaction.type = type;
+    transaction.key = key;
+    transaction.value = value;
+    transaction.successes = transaction.failures = 0;
+    newestRead.erase(transID);
+    opened.push_back(make_pair(par->getcurrtime(), transID));
+}
+
+/**
+ * FUNCTION NAME: closeTransaction
+ *
+ * DESCRIPTION: Forgets a transaction once it succeeded, failed or timed out; the replies
+ * 				still to come for it are then ignored
+ */
+void MP2Node::closeTransaction(int transID) {
+    TransID.erase(transID);
+    newestRead.erase(transID);
+}
+
+/**
+ * FUNCTION NAME: expireTransactions
+ *
+ * DESCRIPTION: Fails the transactions opened TRANSACTION_TIMEOUT ago or more and still
+ * 				undecided, which lost replies or whose replies disagreed too much to decide
+ */
+void MP2Node::expireTransactions() {
+    while(!opened.empty() && opened.front().first + TRANSACTION_TIMEOUT <= par->getcurrtime())
+    {
+        int transID = opened.front().second;
+        opened.pop_front();
+        if(TransID.count(transID))
+            failTransaction(transID);
+    }
+}
+
+/**
+ * FUNCTION NAME: failTransaction
+ *
+ * DESCRIPTION: Logs the coordinator failure of an open transaction and closes it
+ */
+void MP2Node::failTransaction(int transID) {
+    Transaction &transaction = TransID[transID];
+    if(transaction.type == CREATE_)
+        log->logCreateFail(&memberNode->addr, true, transID, transaction.key, transaction.value);
+    else if(transaction.type == READ_)
+        log->logReadFail(&memberNode->addr, true, transID, transaction.key);
+    else if(transaction.type == UPDATE_)
+        log->logUpdateFail(&memberNode->addr, true, transID, transaction.key, transaction.value);
+    else if(transaction.type == DELETE_)
+        log->logDeleteFail(&memberNode->addr, true, transID, transaction.key);
+    closeTransaction(transID);
+}
+
+/**
+ * FUNCTION NAME: handleCreateReply
+ *
+ * DESCRIPTION: A replica stored the key; the create succeeds once all three did
+ */
+void MP2Node::handleCreateReply(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    // the transaction is decided, timed out, or not one of this node's
+    if(count == TransID.end())
+        return;
+    
+    if(++count->second.successes==3)
+    {
+        log->logCreateSuccess(&memberNode->addr, true, msg->transID, string(msg->key), string(msg->value));
+        closeTransaction(msg->transID);
+    }
+}
+
+/**
+ * FUNCTION NAME: handleUpdateReply
+ *
+ * DESCRIPTION: A replica updated the key; the update succeeds with a quorum of two
+ */
+void MP2Node::handleUpdateReply(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+    string key(msg->key), value(msg->value);
+    
+    int successes = ++count->second.successes;
+   
+    info entry= NewEntry(msg->transID,key,value,successes,msg->type);
+    
+    Info[memberNode->addr.getAddress()]=entry;
+    
+    if(successes==2)
+    {
+        log->logUpdateSuccess(&memberNode->addr, true, msg->transID, key, value);
+        closeTransaction(msg->transID);
+        leader=false;
+    }
+}
+
+/**
+ * FUNCTION NAME: handleDeleteReply
+ *
+ * DESCRIPTION: A replica deleted the key; the delete succeeds with a quorum of two
+ */
+void MP2Node::handleDeleteReply(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+    
+    if(++count->second.successes==2)
+    {
+        log->logDeleteSuccess(&memberNode->addr, true, msg->transID, string(msg->key));
+        closeTransaction(msg->transID);
+    }
+}
+
+/**
+ * FUNCTION NAME: handleReadReply
+ *
+ * DESCRIPTION: A replica returned its value; with a quorum of two the read succeeds
+ * 				with the newest value of the quorum (last write wins)
+ */
+void MP2Node::handleReadReply(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+    string key(msg->key), value(msg->value);
+    
+    int successes = ++count->second.successes;
+    
+    info entry = NewEntry(msg->transID,key,value,successes,msg->type);
+
+    Info[memberNode->addr.getAddress()] = entry;
+    
+    pair<uint64_t, string> &newest = newestRead[msg->transID];
+    if(successes==1 || msg->timestamp > newest.first)
+        newest = make_pair(msg->timestamp, value);
+    
+    if(successes==2)
+    {
+        log->logReadSuccess(&memberNode->addr, true, msg->transID, key, newest.second);
+        closeTransaction(msg->transID);
+        leader=false;
+    }
+}
+
+/**
+ * FUNCTION NAME: handleDeleteFail
+ *
+ * DESCRIPTION: A replica did not have the key; the delete fails once two did not
+ */
+void MP2Node::handleDeleteFail(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+    
+    if(++count->second.failures==2)
+    {
+        log->logDeleteFail(&memberNode->addr, true, msg->transID, string(msg->key));
+        closeTransaction(msg->transID);
+    }
+}
+
+/**
+ * FUNCTION NAME: handleReadFail
+ *
+ * DESCRIPTION: A replica did not have the key; the read fails once two did not
+ */
+void MP2Node::handleReadFail(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+  
+    if(++count->second.failures==2)
+    {
+        log->logReadFail(&memberNode->addr, true, msg->transID, string(msg->key));
+        closeTransaction(msg->transID);
+    }
+}
+
+/**
+ * FUNCTION NAME: handleUpdateFail
+ *
+ * DESCRIPTION: A replica did not have the key; the update fails once two did not
+ */
+void MP2Node::handleUpdateFail(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+    
+    if(++count->second.failures==2)
+    {
+        log->logUpdateFail(&memberNode->addr, true, msg->transID, string(msg->key), string(msg->value));
+        closeTransaction(msg->transID);
+    }
+}
+
+/**
+ * FUNCTION NAME: handleRejected
+ *
+ * DESCRIPTION: A replica over its memory budget turned the write down. A create, which needs
+ * 				all three replicas, fails at the first rejection; an update once two did.
+ */
+void MP2Node::handleRejected(ServerOp &op) {
+    MessageView *msg = &op.msg;
+    auto count = TransID.find(msg->transID);
+    if(count == TransID.end())
+        return;
+    
+    if(++count->second.failures==(msg->request == CREATE_ ? 1 : 2))
+    {
+        if(msg->request == CREATE_)
+            log->logCreateFail(&memberNode->addr, true, msg->transID, string(msg->key), string(msg->value));
+        if(msg->request == UPDATE_)
+            log->logUpdateFail(&memberNode->addr, true, msg->transID, string(msg->key), string(msg->value));
+        closeTransaction(msg->transID);
+    }
+}
+
 /**
  * FUNCTION NAME: checkMessages
  *
  * DESCRIPTION: This function is the message handler of this node.
  * 				This function does the following:
- * 				1) Pops messages from the queue
- * 				2) Handles the messages according to message types
+ * 				1) Pops messages from the queue, each a batch of frames, fails the
+ * 				   transactions that timed out, then rejects the writes among them if the
+ * 				   node is over its memory budget
+ * 				2) Applies the CRUD messages to the hash table, on the worker threads if any
+ * 				3) Handles the messages in arrival order, through the handler of their type
+ * 				4) Group commit: the mutations of the whole drain reach the commit log
+ * 				   with one write, and only then are the replicas' replies queued; if the
+ * 				   write fails, the acknowledgements of writes wait for a commit that succeeds
+ * 				5) Background work: rebuild from a snapshot, key expiry, periodic snapshots,
+ * 				   tombstone garbage collection
  */
 void MP2Node::checkMessages() {
 
     char * data;
-    int size;
+    vector<ServerOp> ops;
+    // the messages decode in place, so their datagrams are kept until handled
+    vector<char *> frames;
+    unsigned long queued = 0;
     
     while ( !memberNode->mp2q.empty() ) {
         
         data = (char *)memberNode->mp2q.front().elt;
-        size = memberNode->mp2q.front().size;
+        int size = memberNode->mp2q.front().size;
         memberNode->mp2q.pop();
+        frames.push_back(data);
+        queued += size;
         
-        string message(data, data + size);
-        
-        Message_* msg = (Message_*)data;
-        
-        if(msg->type == CREATE_)
-        {
-            if(!createKeyValue(msg->key, msg->value))
-                continue;
-            
-            Message_ *reply = new Message_(msg->transID,memberNode->addr,CREATEREPLY_,msg->key,msg->value);
-            
-            emulNet->ENsend(&memberNode->addr,&msg->fromAddr ,(char *)reply,sizeof(Message_));
-        }
-        if(msg->type == READ_)
-        {
-            string read = readKey(msg->key);
-            
-            MessageType_ type= read.empty() ?  READFAIL_ : READREPLY_ ;
-            
-            Message_ *reply = new Message_(msg->transID,memberNode->addr,type,msg->key,read);
-            
-            emulNet->ENsend(&memberNode->addr,&msg->fromAddr ,(char *)reply,sizeof(Message_));
-        }
-        if(msg->type == DELETE_)
-        {
-            MessageType_ type = deletekey(msg->key) ? DELETEREPLY_ : DELETEFAIL_;
-            
-            Message_ *reply = new Message_(msg->transID,memberNode->addr, type,msg->key,msg->value);
-            
-            emulNet->ENsend(&memberNode->addr,&msg->fromAddr ,(char *)reply,sizeof(Message_));
-        }
-        if(msg->type == UPDATE_)
-        {
-            MessageType_ type = updateKeyValue(msg->key, msg->value, PRIMARY) ?UPDATEREPLY_ : UPDATEFAIL_;
-            
-            Message_ *reply = new Message_(msg->transID,memberNode->addr,type, msg->key,msg->value);
-            
-            emulNet->ENsend(&memberNode->addr,&msg->fromAddr ,(char *)reply,sizeof(Message_));
-        }
-        if(msg->type == CREATEREPLY_)
-        {
-            TransID[msg->transID]++;
-            
-            if(TransID[msg->transID]==3)
-                log->logCreateSuccess(&memberNode->addr, true, msg->transID,msg->key, msg->value);
-        }
-        
-        if(msg->type == UPDATEREPLY_)
+        // a datagram carries a batch of frames
+        size_t offset = 0;
+        while(offset < (size_t)size)
         {
-            TransID[msg->transID]++;
-           
-            info entry= NewEntry(msg->transID,msg->key,msg->value,TransID[msg->transID],msg->type);
-            
-            Info[memberNode->addr.getAddress()]=entry;
-            
-            if(TransID[msg->transID]==2)
+            ServerOp op;
+            size_t used = op.msg.decode(string_view(data + offset, size - offset));
+            if(used == 0)
             {
-                log->logUpdateSuccess(&memberNode->addr, true, msg->transID, msg->key, msg->value);
-                leader=false;
+                log->LOG(&memberNode->addr, "Dropped %d malformed bytes of a message", size - (int)offset);
+                break;
             }
+            offset += used;
+            op.success = false;
+            op.rejected = false;
+            op.malformed = false;
+            op.timestamp = 0;
+            ops.push_back(op);
             
+            clock->observe(op.msg.timestamp);
         }
-        if(msg->type == DELETEREPLY_)
+    }
+    
+    expireTransactions();
+    
+    // reads and deletes are still served
+    if(checkBudget(queued))
+        for(auto &op : ops)
+            op.rejected = op.msg.type == CREATE_ || op.msg.type == UPDATE_;
+    
+    executeServerOps(ops);
+    
+    for(auto &op : ops)
+    {
+        if(op.msg.type < MESSAGE_TYPES)
+            (this->*handlers[op.msg.type])(op);
+        else
+            log->LOG(&memberNode->addr, "Ignored a message of unknown type %d (version %d)", op.msg.type, op.msg.version);
+    }
+    
+    // a failed commit is retried next drain; until one succeeds the acknowledgements of
+    // the writes wait with it, since they are not durable yet
+    bool durable = !commitLog || commitLog->commit(par->getcurrtime()) == SUCCESS;
+    vector<pair<Address, Message_ *> > held;
+    
+    for(auto &reply : replies)
+    {
+        if(!durable && isWriteAck(reply.second->type))
         {
-            TransID[msg->transID]++;
-            
-            if(TransID[msg->transID]==2)
-                log->logDeleteSuccess(&memberNode->addr, true, msg->transID, msg->key);
-            
+            held.push_back(reply);
+            continue;
         }
-        if(msg->type == READREPLY_)
-        {
-            TransID[msg->transID]++;
-            
-            info entry = NewEntry(msg->transID,msg->key,msg->value,TransID[msg->transID],msg->type);
+        sendMessage(&reply.first, reply.second);
+        messages->release(reply.second);
+    }
+    if(!durable)
+        log->LOG(&memberNode->addr, "Commit log write failed, holding back %lu acknowledgements", (unsigned long)held.size());
+    replies.swap(held);
+    
+    for(auto frame : frames)
+        free(frame);
+    
+    if(restoring)
+        restoreStep(RESTORE_BATCH);
+    
+    expireKeys();
+    
+    if(par->SNAPSHOT_PERIOD > 0 && par->getcurrtime() - lastSnapshot >= par->SNAPSHOT_PERIOD)
+        takeSnapshot();
+    
+    if(par->TOMBSTONE_GRACE > 0 && par->getcurrtime() - lastPurge >= par->TOMBSTONE_GRACE)
+        purgeTombstones();
+}
 
-            Info[memberNode->addr.getAddress()] = entry;
-            
-            if(TransID[msg->transID]==2)
-            {
-                log->logReadSuccess(&memberNode->addr, true, msg->transID, msg->key, msg->value);
-                leader=false;
-            }
-        }
-        
-        if(msg->type == DELETEFAIL_)
+/**
+ * FUNCTION NAME: encodeValue
+ *
+ * DESCRIPTION: Encodes the record of a written value, compressing the value if COMPRESSION
+ * 				is on, it has at least COMPRESSION_MIN_SIZE bytes and it actually shrinks.
+ * 				A value flagged RECORD_COMPRESSED is already compressed.
+ */
+void MP2Node::encodeValue(string &out, uint64_t timestamp, uint8_t flags, string_view value, uint32_t expiry) {
+    string packed;
+    
+    if(par->COMPRESSION && !(flags & RECORD_COMPRESSED) && value.size() >= (size_t)par->COMPRESSION_MIN_SIZE)
+    {
+        LZCodec::compress(value, &packed);
+        if(packed.size() < value.size())
         {
-            TransID[msg->transID]--;
-            
-            if(TransID[msg->transID]==-2)
-                log->logDeleteFail(&memberNode->addr, true, msg->transID, msg->key);
-            
+            flags |= RECORD_COMPRESSED;
+            value = packed;
         }
-        if(msg->type == READFAIL_)
+    }
+    Record::encode(out, timestamp, flags, value, expiry);
+}
+
+/**
+ * FUNCTION NAME: scheduleExpiry
+ *
+ * DESCRIPTION: Arms the expiry timer of a key stored with an encoded record having a TTL
+ */
+void MP2Node::scheduleExpiry(string_view key, string_view record) {
+    Record decoded;
+    
+    if(Record::decode(record, &decoded) && decoded.expiry)
+        expiries->schedule(key, decoded.expiry);
+}
+
+/**
+ * FUNCTION NAME: expireKeys
+ *
+ * DESCRIPTION: Advances the expiry timer wheel to the current time, turning the keys
+ * 				whose TTL ran out into tombstones. A timer whose key was rewritten since
+ * 				finds no due record and does nothing.
+ */
+void MP2Node::expireKeys() {
+    unsigned long expired = 0;
+    uint32_t now = par->getcurrtime();
+    
+    expiries->advance(now, [this, now, &expired](const string &key, uint32_t deadline)
+    {
+        if(ht->expireIfDue(key, now))
         {
-            TransID[msg->transID]--;
-          
-            if(TransID[msg->transID]==-2)
-                log->logReadFail(&memberNode->addr, true, msg->transID, msg->key);
+            invalidateKey(key);
+            expired++;
         }
-        if(msg->type == UPDATEFAIL_)
+    });
+    
+    if(expired)
+        log->LOG(&memberNode->addr, "Expired %lu keys", expired);
+}
+
+/**
+ * FUNCTION NAME: purgeTombstones
+ *
+ * DESCRIPTION: Garbage collects the tombstones older than TOMBSTONE_GRACE, one shard per
+ * 				worker thread if any. Until then a delete is repaired like any other write;
+ * 				a replica that is still missing it after the grace period may bring the key back.
+ * 				Not run while restoring, when a tombstone hides an older snapshot value.
+ */
+void MP2Node::purgeTombstones() {
+    unsigned long purged = 0;
+    
+    if(restoring || par->getcurrtime() <= par->TOMBSTONE_GRACE)
+        return;
+    lastPurge = par->getcurrtime();
+    
+    uint64_t horizon = (uint64_t)(par->getcurrtime() - par->TOMBSTONE_GRACE) << HLC_PHYSICAL_SHIFT;
+    
+    if(!workers)
+    {
+        for(unsigned int shard = 0; shard < ht->shardCount(); shard++)
+            purged += ht->purgeTombstones(horizon, shard);
+    }
+    else
+    {
+        vector<unsigned long> counts(workers->size(), 0);
+        int count = workers->size();
+        workers->run([this, horizon, &counts, count](int worker)
         {
-            TransID[msg->transID]--;
-            
-            if(TransID[msg->transID]==-2)
-                log->logUpdateFail(&memberNode->addr, true, msg->transID, msg->key, msg->value);
-        }
+            for(unsigned int shard = worker; shard < ht->shardCount(); shard += count)
+                counts[worker] += ht->purgeTombstones(horizon, shard);
+        });
+        for(auto n : counts)
+            purged += n;
     }
+    
+    if(purged)
+        log->LOG(&memberNode->addr, "Purged %lu tombstones", purged);
 }
 
 /**
@@ -406,7 +1442,15 @@ void MP2Node::checkMessages() {
  * 				This function is responsible for finding the replicas of a key
  */
 vector<Node> MP2Node::findNodes(string key) {
-    size_t pos = hashFunction(key);
+    return findNodes(ring, hashFunction(key));
+}
+
+/**
+ * FUNCTION NAME: findNodes
+ *
+ * DESCRIPTION: Find the replicas of the ring position pos in the given ring
+ */
+vector<Node> MP2Node::findNodes(vector<Node> &ring, size_t pos) {
     vector<Node> addr_vec;
     if (ring.size() >= 3) {
         // if pos <= min || pos > max, the leader is the min
@@ -431,10 +1475,23 @@ vector<Node> MP2Node::findNodes(string key) {
     return addr_vec;
 }
 
+/**
+ * FUNCTION NAME: isStreamer
+ *
+ * DESCRIPTION: Returns true if this node streams a range whose old replicas were before:
+ * 				the first of them still in the ring does, so each key is sent once
+ */
+bool MP2Node::isStreamer(vector<Node> &before) {
+    for(auto &node : before)
+        if(hasNode(ring, node.getAddress()))
+            return *node.getAddress() == memberNode->addr;
+    return false;
+}
+
 /**
  * FUNCTION NAME: recvLoop
  *
- * DESCRIPTION: Receive messages from EmulNet and push into the queue (mp2q)
+ * DESCRIPTION: Receive messages from the network and push into the queue (mp2q)
  */
 bool MP2Node::recvLoop() {
     if ( memberNode->bFailed ) {
@@ -462,35 +1519,95 @@ int MP2Node::enqueueWrapper(void *env, char *buff, int size) {
  * 				The function does the following:
  *				1) Ensures that there are three "CORRECT" replicas of all the keys in spite of failures and joins
  *				Note:- "CORRECT" replicas implies that every key is replicated in its two neighboring nodes in the ring
+ *				2) Only the token ranges whose replicas changed between oldRing and the new ring
+ *				   are streamed to the replicas that gained them, each by one replica that held
+ *				   them: the first one still in the ring. When a replica left, the others are
+ *				   streamed to as well.
  */
 
-void MP2Node::stabilizationProtocol(vector<Node> list) {
+void MP2Node::stabilizationProtocol(vector<Node> oldRing) {
 
-    for(auto it=ht->hashTable.begin(); it!=ht->hashTable.end();it++)
+    // every key must be in the hash table before it is streamed
+    if(restoring)
+        restoreStep(restoring->size());
+    
+    // ranges start right after a node's position, so within one range neither ring changes owner
+    set<size_t> cuts;
+    for(auto &node : oldRing)
+        cuts.insert((node.getHashCode() + 1) % RING_SIZE);
+    for(auto &node : ring)
+        cuts.insert((node.getHashCode() + 1) % RING_SIZE);
+    vector<size_t> bounds(cuts.begin(), cuts.end());
+    
+    // every range is streamed as of the same point in time
+    uint64_t view = ht->openView();
+    // one message reused for every key
+    Message_ *msg = messages->acquire();
+    
+    for(size_t i = 0; i < bounds.size(); i++)
     {
-       
-        Message_* msg = new Message_(g_transID,memberNode->addr,CREATE_,it->first,it->second);
+        size_t first = bounds[i], last = bounds[(i + 1) % bounds.size()];
+        
+        vector<Node> before = findNodes(oldRing, first);
+        vector<Node> after = findNodes(ring, first);
         
-        vector<Node> replicas=findNodes(it->first);
+        // with no full old ring every node streams what it has
+        if(!before.empty() && !isStreamer(before))
+            continue;
         
-        for(auto replica : replicas)
-            emulNet->ENsend(&memberNode->addr,replica.getAddress(),(char *)msg,sizeof(Message_));
+        // an old replica that left may have been the streamer of an earlier change, dead
+        // before it was detected: the replicas that change gave the range are refreshed too
+        bool replicaLeft = false;
+        for(auto &node : before)
+            if(!hasNode(ring, node.getAddress()))
+                replicaLeft = true;
+        
+        vector<Node> targets;
+        for(auto &node : after)
+            if((replicaLeft || !hasNode(before, node.getAddress())) && !(*node.getAddress() == memberNode->addr))
+                targets.push_back(node);
+        
+        if(targets.empty())
+            continue;
+        
+        ht->scanRangeAt(first, last, view, [this, &targets, msg](string_view key, string_view stored)
+        {
+            Record record;
+            if(!Record::decode(stored, &record))
+                return;
+            
+            // the original timestamp travels along, so the resend never overrides a newer write
+            // tombstones too, so that a replica gaining the range learns of the delete,
+            // and compressed values stay compressed on the wire
+            msg->assign(STREAM_TRANSID,memberNode->addr,CREATE_,key,record.value);
+            msg->timestamp = record.timestamp;
+            msg->flags = record.flags;
+            msg->expiry = record.expiry;
+            
+            sendMessage(targets, msg);
+        });
     }
     
+    ht->closeView(view);
+    messages->release(msg);
+    
     if(leader==true)
     {
+        info &last = Info[memberNode->addr.getAddress()];
         
-        if(Info[memberNode->addr.getAddress()].count==1)
+        // a transaction already decided or timed out was logged then
+        if(last.count==1 && TransID.count(last.TransID))
         {
-            MessageType_ type = Info[memberNode->addr.getAddress()].type;
+            MessageType_ type = last.type;
             
             if(type==READREPLY_)
-                log->logReadFail(&memberNode->addr, true, Info[memberNode->addr.getAddress()].TransID,
-                                 Info[memberNode->addr.getAddress()].key);
+                log->logReadFail(&memberNode->addr, true, last.TransID, last.key);
             
             if(type==UPDATEREPLY_)
-                log->logUpdateFail(&memberNode->addr, true, Info[memberNode->addr.getAddress()].TransID,
-                                   Info[memberNode->addr.getAddress()].key,Info[memberNode->addr.getAddress()].value);
+                log->logUpdateFail(&memberNode->addr, true, last.TransID, last.key, last.value);
+            // decided: a later ring change must not fail it a second time
+            last.count=0;
+            closeTransaction(last.TransID);
             leader=false;
         }
     }
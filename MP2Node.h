@@ -11,13 +11,44 @@
  * Header files
  */
 #include "stdincludes.h"
-#include "EmulNet.h"
+#include "Network.h"
 #include "Node.h"
 #include "HashTable.h"
+#include "CommitLog.h"
+#include "Snapshot.h"
+#include "WorkerPool.h"
+#include "HybridClock.h"
+#include "TimerWheel.h"
+#include "RowCache.h"
+#include "MemoryBudget.h"
+#include "Record.h"
+#include "Coding.h"
 #include "Log.h"
 #include "Params.h"
 #include "Queue.h"
+#include "ObjectPool.h"
 #include <map>
+#include <set>
+#include <deque>
+#include <unordered_set>
+
+// snapshot entries copied into the hash table per tick while restoring
+#define RESTORE_BATCH 1024
+// bytes accounted for each transaction this node coordinates (map node and counters)
+#define PENDING_ENTRY_SIZE 64
+// time units a coordinator waits for the replies of a transaction before forgetting it
+#define TRANSACTION_TIMEOUT 20
+// transID of the keys stabilization streams: transactions start at 1, so the replies are ignored
+#define STREAM_TRANSID 0
+// first bytes of every envelope, "KV" in little-endian order
+#define MESSAGE_MAGIC 0x564B
+// layout of the messages this node sends; newer layouts only append fields to the body
+#define MESSAGE_VERSION 1
+// [u16 magic][u8 version][u8 type][u8 flags][u8 request][u8 replica | success << 2][u8 reserved]
+#define MESSAGE_ENVELOPE 8
+// the envelope then [6 bytes fromAddr]
+#define MESSAGE_HEADER (MESSAGE_ENVELOPE + 6)
+
 /**
  * CLASS NAME: MP2Node
  *
@@ -30,8 +61,21 @@
  */
 
 // message types, reply is the message from node to coordinator
-enum MessageType_ {CREATE_, READ_, UPDATE_, DELETE_, UPDATEREPLY_,DELETEREPLY_,CREATEREPLY_, READREPLY_,
-    DELETEFAIL_,READFAIL_,UPDATEFAIL_};
+// (one byte on the wire, so a type from a newer version can be held and ignored)
+enum MessageType_ : uint8_t {CREATE_, READ_, UPDATE_, DELETE_, UPDATEREPLY_,DELETEREPLY_,CREATEREPLY_, READREPLY_,
+    DELETEFAIL_,READFAIL_,UPDATEFAIL_,REJECTED_};
+// number of message types this version knows, the size of the dispatch table
+#define MESSAGE_TYPES (REJECTED_ + 1)
+
+// CRUD requests served by the replicas of a key
+inline bool isServerOp(MessageType_ type) {
+    return type == CREATE_ || type == READ_ || type == UPDATE_ || type == DELETE_;
+}
+
+// replies acknowledging a mutation, sent only once it is in the commit log
+inline bool isWriteAck(MessageType_ type) {
+    return type == CREATEREPLY_ || type == UPDATEREPLY_ || type == DELETEREPLY_;
+}
 
 // Transaction Id
 static int g_transID = 0;
@@ -48,6 +92,16 @@ public:
     
 };
 
+// a transaction this node coordinates: the replies counted, and what to log if it times out
+class Transaction{
+public:
+    MessageType_ type;
+    string key;
+    string value;
+    int successes;
+    int failures;
+};
+
 class Message_{
 public:
     MessageType_ type;
@@ -57,9 +111,29 @@ public:
     Address fromAddr;
     int transID;
     bool success; // success or not
+    // hybrid logical clock timestamp of the write, or of the value read
+    uint64_t timestamp;
+    // Record flags of the value carried (RECORD_TOMBSTONE)
+    uint8_t flags;
+    // globaltime at which the value expires, 0 for never
+    uint32_t expiry;
+    // REJECTED_: type of the request the replica turned down
+    MessageType_ request;
     // delimiter
     string delimiter;
-    // construct a message from a string
+    // construct an empty message, to be set by assign
+    Message_()
+    {
+        this->delimiter = "::";
+        transID = 0;
+        type = CREATE_;
+        replica = PRIMARY;
+        success = false;
+        timestamp = 0;
+        flags = 0;
+        expiry = 0;
+        request = CREATE_;
+    }
 
     // construct a create or update message
     Message_(int _transID, Address _fromAddr, MessageType_ _type, string _key, string _value)
@@ -71,6 +145,12 @@ public:
             type = _type;
             key = _key;
             value = _value;
+            replica = PRIMARY;
+            success = false;
+            timestamp = 0;
+            flags = 0;
+            expiry = 0;
+            request = _type;
         
     }
     // construct a read or delete message
@@ -81,12 +161,75 @@ public:
         fromAddr = _fromAddr;
         type = _type;
         key = _key;
+        replica = PRIMARY;
+        success = false;
+        timestamp = 0;
+        flags = 0;
+        expiry = 0;
+        request = _type;
+    }
+    
+    // reinitialize a message, reusing the capacity of its strings
+    void assign(int _transID, Address &_fromAddr, MessageType_ _type, string_view _key, string_view _value = string_view())
+    {
+        transID = _transID;
+        fromAddr = _fromAddr;
+        type = _type;
+        key.assign(_key.data(), _key.size());
+        value.assign(_value.data(), _value.size());
+        replica = PRIMARY;
+        success = false;
+        timestamp = 0;
+        flags = 0;
+        expiry = 0;
+        request = _type;
     }
     
+    // the wire frame of the message: its size, written into a caller's buffer or appended to out
+    size_t frameSize();
+    size_t encodeInto(char *buffer, size_t capacity);
+    void encode(string &out);
+
+};
 
+// a message decoded in place: key and value point into the received frame
+class MessageView {
+public:
+    // envelope version of the sender
+    uint8_t version;
+    MessageType_ type;
+    ReplicaType replica;
+    string_view key;
+    string_view value;
+    Address fromAddr;
+    int transID;
+    bool success;
+    uint64_t timestamp;
+    uint8_t flags;
+    uint32_t expiry;
+    MessageType_ request;
+    
+    // decode the frame at the start of bytes, returning its size (0 if malformed)
+    size_t decode(string_view bytes);
 };
 
 
+// a drained message and, for CRUD requests, the outcome of applying it
+class ServerOp {
+public:
+    MessageView msg;
+    bool success;
+    // a write turned down because the node is over its memory budget
+    bool rejected;
+    // a create whose compressed value does not decompress, dropped like a malformed frame
+    bool malformed;
+    // value read (READ_), or decompressed value of a compressed create
+    string read;
+    // record written (CREATE_/UPDATE_/DELETE_) or timestamp of the value read
+    string record;
+    uint64_t timestamp;
+};
+
 class MP2Node {
 private:
 
@@ -94,22 +237,90 @@ private:
 	vector<Node> ring;
 	// Hash Table
 	HashTable * ht;
+	// Write-ahead log of the hash table, NULL when disabled
+	CommitLog * commitLog;
+	// Replies held back until the mutations they acknowledge are committed
+	vector<pair<Address, Message_ *> > replies;
+	// recycles the messages this node builds, so that none is allocated in the steady state
+	ObjectPool<Message_> * messages;
+	// frames are encoded here before they are sent, MAX_MSG_SIZE bytes
+	char * sendBuffer;
+	// frames of the current tick per destination (by its address bytes), sent as one datagram
+	map<string, pair<Address, string> > outbound;
+	// largest message the network delivers
+	size_t batchLimit;
+	// Snapshot serving reads while the hash table is rebuilt from it, NULL otherwise
+	Snapshot * restoring;
+	// next snapshot entry to copy into the hash table
+	uint64_t restoreCursor;
+	int lastSnapshot;
+	int lastPurge;
+	// threads applying CRUD requests, NULL to apply them on the node's thread
+	WorkerPool * workers;
+	// timestamps the writes this node coordinates
+	HybridClock * clock;
+	// keys with a TTL, by expiry time
+	TimerWheel * expiries;
+	// records recently read from the hash table, NULL when disabled
+	RowCache * rowCache;
+	// memory held by this node against MEMORY_BUDGET
+	MemoryBudget * budget;
+	bool overBudget;
+	// newest (timestamp, value) among the read replies of each transaction
+	map<int, pair<uint64_t, string> > newestRead;
 	// Member representing this member
 	Member *memberNode;
 	// Params object
 	Params *par;
-	// Object of EmulNet
-	EmulNet * emulNet;
+	// Network the node sends through
+	Network * emulNet;
 	// Object of Log
 	Log * log;
     
-    map<int,int> TransID;
+    // the transactions in flight, by id
+    map<int,Transaction> TransID;
+    // (time opened, transaction id) of the transactions, in the order they were opened
+    deque<pair<int,int> > opened;
     map<string,info> Info;
     
     bool leader;
     
+	string dataFile(string name);
+	void restoreSnapshot();
+	void restoreStep(uint64_t count);
+	void promoteKey(string_view key);
+	void executeServerOps(vector<ServerOp> &ops);
+	void executeServerOp(ServerOp &op);
+	void completeServerOp(ServerOp &op);
+	// handlers of the messages a coordinator receives from the replicas
+	void handleCreateReply(ServerOp &op);
+	void handleUpdateReply(ServerOp &op);
+	void handleDeleteReply(ServerOp &op);
+	void handleReadReply(ServerOp &op);
+	void handleDeleteFail(ServerOp &op);
+	void handleReadFail(ServerOp &op);
+	void handleUpdateFail(ServerOp &op);
+	void handleRejected(ServerOp &op);
+	// handler of each message type, indexed by type
+	typedef void (MP2Node::*MessageHandler)(ServerOp &op);
+	static const MessageHandler handlers[MESSAGE_TYPES];
+	void purgeTombstones();
+	void scheduleExpiry(string_view key, string_view record);
+	void encodeValue(string &out, uint64_t timestamp, uint8_t flags, string_view value, uint32_t expiry);
+	void expireKeys();
+	void invalidateKey(string_view key);
+	bool checkBudget(unsigned long queued);
+	void openTransaction(int transID, MessageType_ type, const string &key, const string &value = "");
+	void failTransaction(int transID);
+	void closeTransaction(int transID);
+	void expireTransactions();
+	void sendMessage(vector<Node> &targets, Message_ *msg);
+	void sendMessage(Address *to, Message_ *msg);
+	void queueFrame(Address *to, const char *frame, size_t size);
+	Message_ *newReply(int transID, MessageType_ type, string_view key, string_view value);
+    
 public:
-	MP2Node(Member *memberNode, Params *par, EmulNet *emulNet, Log *log, Address *addressOfMember);
+	MP2Node(Member *memberNode, Params *par, Network *emulNet, Log *log, Address *addressOfMember);
 	Member * getMemberNode() {
 		return this->memberNode;
 	}
@@ -120,32 +331,52 @@ public:
 	size_t hashFunction(string key);
 
 	// client side CRUD APIs
-	void clientCreate(string key, string value);
+	void clientCreate(string key, string value, int ttl = 0);
 	void clientRead(string key);
-	void clientUpdate(string key, string value);
+	void clientUpdate(string key, string value, int ttl = 0);
 	void clientDelete(string key);
 
 	// receive messages from Emulnet
 	bool recvLoop();
+	void replayCommitLog();
 	static int enqueueWrapper(void *env, char *buff, int size);
 
 	// handle messages from receiving queue
 	void checkMessages();
+	// send the frames batched during this tick
+	void flushOutbound();
 
 	// coordinator dispatches messages to corresponding nodes
 	void dispatchMessages(Message_ message);
 
 	// find the addresses of nodes that are responsible for a key
 	vector<Node> findNodes(string key);
+	vector<Node> findNodes(vector<Node> &ring, size_t pos);
 
 	// server
-	bool createKeyValue(string key, string value);
-	string readKey(string key);
-	bool updateKeyValue(string key, string value, ReplicaType replica);
-	bool deletekey(string key);
+	bool createKeyValue(string_view key, string_view value, uint64_t timestamp, string *record, uint8_t flags = 0, uint32_t expiry = 0);
+	string readKey(string_view key, uint64_t *timestamp = NULL);
+	bool updateKeyValue(string_view key, string_view value, ReplicaType replica, uint64_t timestamp, string *record, uint32_t expiry = 0);
+	bool deletekey(string_view key, uint64_t timestamp, string *tombstone);
 
 	// stabilization protocol - handle multiple failures
-	void stabilizationProtocol(vector<Node> list);
+	void stabilizationProtocol(vector<Node> oldRing);
+	bool isStreamer(vector<Node> &before);
+
+	// write the hash table to this node's snapshot and empty the commit log
+	int takeSnapshot();
+
+	// memory held by the local hash table
+	ArenaStats storageStats();
+
+	// hits and misses of the row cache
+	CacheStats cacheStats();
+
+	// memory held by this node, by use, as of the last drain
+	MemoryBudget memoryStats();
+
+	// Message_ objects allocated by this node so far
+	unsigned long messageAllocations();
     info NewEntry(int& TID, string& K, string& V, int& C, MessageType_& T);
     
 	~MP2Node();
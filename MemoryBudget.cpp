@@ -0,0 +1,67 @@
+/**********************************
+ * FILE NAME: MemoryBudget.cpp
+ *
+ * DESCRIPTION: Definition of the memory accounting of a node
+ **********************************/
+
+#include "MemoryBudget.h"
+
+/**
+ * Constructor
+ */
+MemoryBudget::MemoryBudget(unsigned long limit): limit(limit) {
+	for ( int use = 0; use < MEMORY_USES; use++ ) {
+		used[use] = 0;
+	}
+}
+
+/**
+ * FUNCTION NAME: set
+ *
+ * DESCRIPTION: Records the bytes currently held for use
+ */
+void MemoryBudget::set(memoryUSE use, unsigned long bytes) {
+	used[use] = bytes;
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Returns the bytes last recorded for use
+ */
+unsigned long MemoryBudget::get(memoryUSE use) {
+	return used[use];
+}
+
+/**
+ * FUNCTION NAME: total
+ *
+ * DESCRIPTION: Returns the bytes held for all uses
+ */
+unsigned long MemoryBudget::total() {
+	unsigned long bytes = 0;
+	for ( int use = 0; use < MEMORY_USES; use++ ) {
+		bytes += used[use];
+	}
+	return bytes;
+}
+
+/**
+ * FUNCTION NAME: getLimit
+ *
+ * DESCRIPTION: Returns the budget in bytes, 0 for unlimited
+ */
+unsigned long MemoryBudget::getLimit() {
+	return limit;
+}
+
+/**
+ * FUNCTION NAME: exceeded
+ *
+ * RETURNS:
+ * true if the node holds more than its budget
+ * false otherwise, or if unlimited
+ */
+bool MemoryBudget::exceeded() {
+	return limit > 0 && total() > limit;
+}
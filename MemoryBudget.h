@@ -0,0 +1,41 @@
+/**********************************
+ * FILE NAME: MemoryBudget.h
+ *
+ * DESCRIPTION: Header file of the memory accounting of a node
+ **********************************/
+
+#ifndef MEMORYBUDGET_H_
+#define MEMORYBUDGET_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+
+// what the memory of a node is used for
+enum memoryUSE { MEMORY_STORAGE, MEMORY_QUEUE, MEMORY_PENDING, MEMORY_USES };
+
+/**
+ * CLASS NAME: MemoryBudget
+ *
+ * DESCRIPTION: Bytes a node holds for each use, against the limit it must stay under.
+ * 				MEMORY_STORAGE: hash table and row cache
+ * 				MEMORY_QUEUE: received messages waiting to be handled
+ * 				MEMORY_PENDING: state of the transactions this node coordinates
+ * 				The uses are measured by their owners; the budget only adds them up.
+ */
+class MemoryBudget {
+private:
+	// 0 for unlimited
+	unsigned long limit;
+	unsigned long used[MEMORY_USES];
+public:
+	MemoryBudget(unsigned long limit);
+	void set(memoryUSE use, unsigned long bytes);
+	unsigned long get(memoryUSE use);
+	unsigned long total();
+	unsigned long getLimit();
+	bool exceeded();
+};
+
+#endif /* MEMORYBUDGET_H_ */
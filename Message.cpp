@@ -174,3 +174,67 @@ Message& Message::operator =(const Message& anotherMessage) {
 	this->value = anotherMessage.value;
 	return *this;
 }
+
+/**
+ * FUNCTION NAME: encode
+ *
+ * DESCRIPTION: Appends the binary frame of the message to out:
+ * 				[varint32 size][u8 type][u8 replica | success << 2][6 bytes fromAddr]
+ * 				[varint32 transID][varint32 key size][key][varint32 value size][value]
+ */
+void Message::encode(string &out) {
+	size_t size = 2 + sizeof(fromAddr.addr) + varintLength((uint32_t)transID) + varintLength(key.size()) + key.size() + varintLength(value.size()) + value.size();
+	out.reserve(out.size() + varintLength(size) + size);
+	putVarint32(out, (uint32_t)size);
+	out.push_back((char)type);
+	out.push_back((char)(replica | (success ? 4 : 0)));
+	out.append(fromAddr.addr, sizeof(fromAddr.addr));
+	putVarint32(out, (uint32_t)transID);
+	putLengthPrefixed(out, key);
+	putLengthPrefixed(out, value);
+}
+
+/**
+ * FUNCTION NAME: decode
+ *
+ * DESCRIPTION: Replaces the fields with those of the frame at the start of bytes
+ *
+ * RETURNS:
+ * size of the frame
+ * 0 if bytes do not start with a complete, valid frame
+ */
+size_t Message::decode(string_view bytes) {
+	const char *p = bytes.data(), *limit = bytes.data() + bytes.size();
+	uint32_t size, id;
+	string_view keyBytes, valueBytes;
+
+	p = getVarint32(p, limit, &size);
+	if ( p == NULL || size > (size_t)(limit - p) || size < 2 + sizeof(fromAddr.addr) ) {
+		return 0;
+	}
+	limit = p + size;
+	if ( (unsigned char)p[0] > READREPLY || (p[1] & 3) > TERTIARY ) {
+		return 0;
+	}
+	MessageType frameType = static_cast<MessageType>(p[0]);
+	ReplicaType frameReplica = static_cast<ReplicaType>(p[1] & 3);
+	bool frameSuccess = (p[1] & 4) != 0;
+	const char *addr = p + 2;
+	p += 2 + sizeof(fromAddr.addr);
+
+	p = getVarint32(p, limit, &id);
+	p = p ? getLengthPrefixed(p, limit, &keyBytes) : NULL;
+	p = p ? getLengthPrefixed(p, limit, &valueBytes) : NULL;
+	if ( p != limit ) {
+		return 0;
+	}
+
+	type = frameType;
+	replica = frameReplica;
+	success = frameSuccess;
+	memcpy(fromAddr.addr, addr, sizeof(fromAddr.addr));
+	transID = (int)id;
+	key.assign(keyBytes.data(), keyBytes.size());
+	value.assign(valueBytes.data(), valueBytes.size());
+	return limit - bytes.data();
+}
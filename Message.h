@@ -9,6 +9,8 @@
 #include "stdincludes.h"
 #include "Member.h"
 #include "common.h"
+#include "Coding.h"
+#include <string_view>
 
 /**
  * CLASS NAME: Message
@@ -41,6 +43,9 @@ public:
 	Message& operator = (const Message& anotherMessage);
 	// serialize to a string
 	string toString();
+	// binary frame, without the text parsing
+	void encode(string &out);
+	size_t decode(string_view bytes);
 };
 
 #endif
@@ -0,0 +1,128 @@
+/**********************************
+ * FILE NAME: MpscRing.h
+ *
+ * DESCRIPTION: Header file of the bounded lock-free queue between many senders and one receiver
+ **********************************/
+
+#ifndef MPSCRING_H_
+#define MPSCRING_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <atomic>
+#include <stdint.h>
+
+// assumed size of a cache line, to keep the producers' and the consumer's counters apart
+#define CACHE_LINE_SIZE 64
+
+/**
+ * CLASS NAME: MpscRing
+ *
+ * DESCRIPTION: Bounded queue of T for any number of producer threads and a single consumer
+ * 				thread, after Dmitry Vyukov's bounded queue: each slot carries a sequence
+ * 				number telling whether it is free for the push of a given position or holds
+ * 				the value of a given position. A push claims a position with one CAS on tail,
+ * 				retried only if another producer claimed it first, and never waits for the
+ * 				consumer; pop takes no lock and touches no shared counter but the slot.
+ * 				head and tail sit on cache lines of their own.
+ * 				The capacity is rounded up to a power of two.
+ */
+template <class T>
+class MpscRing {
+private:
+	class Slot {
+	public:
+		atomic<uint64_t> sequence;
+		T value;
+	};
+	Slot *slots;
+	uint64_t mask;
+	alignas(CACHE_LINE_SIZE) atomic<uint64_t> tail;
+	// only ever read and written by the consumer
+	alignas(CACHE_LINE_SIZE) uint64_t head;
+public:
+	MpscRing(uint64_t capacity): tail(0), head(0) {
+		uint64_t size = 2;
+		while ( size < capacity ) {
+			size <<= 1;
+		}
+		slots = new Slot[size];
+		mask = size - 1;
+		for ( uint64_t i = 0; i < size; i++ ) {
+			slots[i].sequence.store(i, memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * FUNCTION NAME: push
+	 *
+	 * DESCRIPTION: Appends value; may be called from any thread
+	 *
+	 * RETURNS:
+	 * true on SUCCESS
+	 * false if the ring is full
+	 */
+	bool push(const T &value) {
+		uint64_t pos = tail.load(memory_order_relaxed);
+		Slot *slot;
+		for ( ;; ) {
+			slot = &slots[pos & mask];
+			int64_t lag = (int64_t)(slot->sequence.load(memory_order_acquire) - pos);
+			if ( lag == 0 ) {
+				if ( tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed) ) {
+					break;
+				}
+			}
+			else if ( lag < 0 ) {
+				// the slot still holds the value pushed one lap ago
+				return false;
+			}
+			else {
+				pos = tail.load(memory_order_relaxed);
+			}
+		}
+		slot->value = value;
+		slot->sequence.store(pos + 1, memory_order_release);
+		return true;
+	}
+
+	/**
+	 * FUNCTION NAME: drain
+	 *
+	 * DESCRIPTION: Moves up to max values, oldest first, into out; consumer thread only.
+	 * 				Stops at the first slot whose push is not complete yet.
+	 *
+	 * RETURNS:
+	 * number of values moved
+	 */
+	size_t drain(T *out, size_t max) {
+		size_t count = 0;
+		while ( count < max ) {
+			Slot *slot = &slots[head & mask];
+			if ( slot->sequence.load(memory_order_acquire) != head + 1 ) {
+				break;
+			}
+			out[count++] = slot->value;
+			slot->sequence.store(head + mask + 1, memory_order_release);
+			head++;
+		}
+		return count;
+	}
+
+	/**
+	 * FUNCTION NAME: getCapacity
+	 *
+	 * DESCRIPTION: Returns the number of values the ring holds when full
+	 */
+	uint64_t getCapacity() {
+		return mask + 1;
+	}
+
+	virtual ~MpscRing() {
+		delete[] slots;
+	}
+};
+
+#endif /* MPSCRING_H_ */
@@ -0,0 +1,33 @@
+/**********************************
+ * FILE NAME: Network.h
+ *
+ * DESCRIPTION: Header file of the interface of the transports between nodes
+ **********************************/
+
+#ifndef _NETWORK_H_
+#define _NETWORK_H_
+
+#include "stdincludes.h"
+#include "Member.h"
+
+/**
+ * CLASS NAME: Network
+ *
+ * DESCRIPTION: What the nodes need of a transport: EmulNet emulates one in memory,
+ * 				SocketNet uses loopback sockets and UringNet drives them through io_uring.
+ * 				A node gets its address from ENinit, sends with ENsend and, once per tick,
+ * 				hands what it received to its queue with ENrecv; every message is a
+ * 				malloc'ed copy the queue owns.
+ */
+class Network {
+public:
+	virtual ~Network() {}
+	virtual void *ENinit(Address *myaddr, short port) = 0;
+	virtual int ENsend(Address *myaddr, Address *toaddr, char *data, int size) = 0;
+	virtual int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) = 0;
+	virtual int ENcleanup() = 0;
+	// size of the largest message ENsend accepts
+	virtual int ENmaxPayload() = 0;
+};
+
+#endif /* _NETWORK_H_ */
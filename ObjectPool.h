@@ -0,0 +1,73 @@
+/**********************************
+ * FILE NAME: ObjectPool.h
+ *
+ * DESCRIPTION: Header file of the free list recycling the objects of one type
+ **********************************/
+
+#ifndef OBJECTPOOL_H_
+#define OBJECTPOOL_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+
+/**
+ * CLASS NAME: ObjectPool
+ *
+ * DESCRIPTION: Hands out objects of type T and takes them back for reuse, so that
+ * 				once the pool holds as many objects as are ever in use at once, no
+ * 				more are allocated. A recycled object keeps its state, including the
+ * 				capacity of its strings; the caller reinitializes it.
+ * 				allocations counts the objects ever built, to check the steady state.
+ * 				Not thread safe: each pool belongs to one thread.
+ */
+template <class T>
+class ObjectPool {
+private:
+	vector<T *> available;
+	unsigned long allocations;
+public:
+	ObjectPool(): allocations(0) {}
+
+	/**
+	 * FUNCTION NAME: acquire
+	 *
+	 * DESCRIPTION: Returns a recycled object, or a new one if none is available
+	 */
+	T *acquire() {
+		if ( available.empty() ) {
+			allocations++;
+			return new T();
+		}
+		T *object = available.back();
+		available.pop_back();
+		return object;
+	}
+
+	/**
+	 * FUNCTION NAME: release
+	 *
+	 * DESCRIPTION: Takes back an object obtained from acquire
+	 */
+	void release(T *object) {
+		available.push_back(object);
+	}
+
+	/**
+	 * FUNCTION NAME: getAllocations
+	 *
+	 * DESCRIPTION: Returns the number of objects built by the pool
+	 */
+	unsigned long getAllocations() {
+		return allocations;
+	}
+
+	virtual ~ObjectPool() {
+		for ( unsigned int i = 0; i < available.size(); i++ ) {
+			delete available[i];
+		}
+	}
+};
+
+#endif /* OBJECTPOOL_H_ */
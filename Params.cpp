@@ -9,7 +9,9 @@
 /**
  * Constructor
  */
-Params::Params(): PORTNUM(8001) {}
+Params::Params(): MSG_CORRUPT_PROB(0), PORTNUM(8001), STORAGE_BACKEND(MAP_STORAGE), MEMTABLE_SIZE(4 << 20), VALUE_LOG_THRESHOLD(0), ROW_CACHE_SIZE(0), MEMORY_BUDGET(0), STORAGE_SHARDS(1), WORKER_THREADS(0), COMMITLOG(0), COMMITLOG_SYNC(SYNC_BATCH), COMMITLOG_PERIOD(10), SNAPSHOT(0), SNAPSHOT_PERIOD(0), TOMBSTONE_GRACE(100), COMPRESSION(0), COMPRESSION_MIN_SIZE(64), NETWORK_CHECKSUM(0), MAILBOX_SIZE(4096), MAILBOX_OVERFLOW(OVERFLOW_DROP), TRANSPORT(EMUL_TRANSPORT) {
+	strcpy(DATA_DIR, ".");
+}
 
 /**
  * FUNCTION NAME: setparams
@@ -19,6 +21,7 @@ Params::Params(): PORTNUM(8001) {}
 void Params::setparams(char *config_file) {
 	//trace.funcEntry("Params::setparams");
 	char CRUD[10];
+	char name[64], value[64];
 	FILE *fp = fopen(config_file,"r");
 
 	fscanf(fp,"MAX_NNB: %d", &MAX_NNB);
@@ -40,6 +43,11 @@ void Params::setparams(char *config_file) {
 		this->CRUDTEST = DELETE_TEST;
 	}
 
+	// Optional "NAME: value" lines may follow the mandatory ones
+	while ( fscanf(fp, " %63[^:]: %63s", name, value) == 2 ) {
+		setoption(name, value);
+	}
+
 	//printf("Parameters of the test case: %d %d %d %lf\n", MAX_NNB, SINGLE_FAILURE, DROP_MSG, MSG_DROP_PROB);
 
 	EN_GPSZ = MAX_NNB;
@@ -56,6 +64,109 @@ void Params::setparams(char *config_file) {
 	return;
 }
 
+/**
+ * FUNCTION NAME: setoption
+ *
+ * DESCRIPTION: Set one optional parameter of the config file. Unknown names are ignored.
+ */
+void Params::setoption(char *name, char *value) {
+	if ( 0 == strcmp(name, "STORAGE_BACKEND") ) {
+		if ( 0 == strcmp(value, "FLAT") ) {
+			this->STORAGE_BACKEND = FLAT_STORAGE;
+		}
+		else if ( 0 == strcmp(value, "MAP") ) {
+			this->STORAGE_BACKEND = MAP_STORAGE;
+		}
+		else if ( 0 == strcmp(value, "LSM") ) {
+			this->STORAGE_BACKEND = LSM_STORAGE;
+		}
+		else if ( 0 == strcmp(value, "TOKEN") ) {
+			this->STORAGE_BACKEND = TOKEN_STORAGE;
+		}
+	}
+	else if ( 0 == strcmp(name, "DATA_DIR") ) {
+		strcpy(this->DATA_DIR, value);
+	}
+	else if ( 0 == strcmp(name, "MEMTABLE_SIZE") ) {
+		this->MEMTABLE_SIZE = strtoul(value, NULL, 10);
+	}
+	else if ( 0 == strcmp(name, "VALUE_LOG_THRESHOLD") ) {
+		this->VALUE_LOG_THRESHOLD = strtoul(value, NULL, 10);
+	}
+	else if ( 0 == strcmp(name, "ROW_CACHE_SIZE") ) {
+		this->ROW_CACHE_SIZE = strtoul(value, NULL, 10);
+	}
+	else if ( 0 == strcmp(name, "MEMORY_BUDGET") ) {
+		this->MEMORY_BUDGET = strtoul(value, NULL, 10);
+	}
+	else if ( 0 == strcmp(name, "STORAGE_SHARDS") ) {
+		this->STORAGE_SHARDS = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "WORKER_THREADS") ) {
+		this->WORKER_THREADS = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "COMMITLOG") ) {
+		this->COMMITLOG = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "COMMITLOG_SYNC") ) {
+		if ( 0 == strcmp(value, "BATCH") ) {
+			this->COMMITLOG_SYNC = SYNC_BATCH;
+		}
+		else if ( 0 == strcmp(value, "PERIODIC") ) {
+			this->COMMITLOG_SYNC = SYNC_PERIODIC;
+		}
+		else if ( 0 == strcmp(value, "NONE") ) {
+			this->COMMITLOG_SYNC = SYNC_NONE;
+		}
+	}
+	else if ( 0 == strcmp(name, "COMMITLOG_PERIOD") ) {
+		this->COMMITLOG_PERIOD = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "SNAPSHOT") ) {
+		this->SNAPSHOT = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "SNAPSHOT_PERIOD") ) {
+		this->SNAPSHOT_PERIOD = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "TOMBSTONE_GRACE") ) {
+		this->TOMBSTONE_GRACE = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "COMPRESSION") ) {
+		this->COMPRESSION = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "COMPRESSION_MIN_SIZE") ) {
+		this->COMPRESSION_MIN_SIZE = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "NETWORK_CHECKSUM") ) {
+		this->NETWORK_CHECKSUM = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "MSG_CORRUPT_PROB") ) {
+		this->MSG_CORRUPT_PROB = atof(value);
+	}
+	else if ( 0 == strcmp(name, "MAILBOX_SIZE") ) {
+		this->MAILBOX_SIZE = atoi(value);
+	}
+	else if ( 0 == strcmp(name, "MAILBOX_OVERFLOW") ) {
+		if ( 0 == strcmp(value, "DROP") ) {
+			this->MAILBOX_OVERFLOW = OVERFLOW_DROP;
+		}
+		else if ( 0 == strcmp(value, "SPIN") ) {
+			this->MAILBOX_OVERFLOW = OVERFLOW_SPIN;
+		}
+	}
+	else if ( 0 == strcmp(name, "TRANSPORT") ) {
+		if ( 0 == strcmp(value, "EMUL") ) {
+			this->TRANSPORT = EMUL_TRANSPORT;
+		}
+		else if ( 0 == strcmp(value, "SOCKET") ) {
+			this->TRANSPORT = SOCKET_TRANSPORT;
+		}
+		else if ( 0 == strcmp(value, "URING") ) {
+			this->TRANSPORT = URING_TRANSPORT;
+		}
+	}
+}
+
 /**
  * FUNCTION NAME: getcurrtime
  *
@@ -13,6 +13,17 @@
 
 enum testTYPE { CREATE_TEST, READ_TEST, UPDATE_TEST, DELETE_TEST };
 
+enum storageTYPE { MAP_STORAGE, FLAT_STORAGE, LSM_STORAGE, TOKEN_STORAGE };
+
+// when the commit log batch is forced to disk
+enum syncPOLICY { SYNC_BATCH, SYNC_PERIODIC, SYNC_NONE };
+
+// how the nodes exchange messages: in memory, or over loopback sockets
+enum transportTYPE { EMUL_TRANSPORT, SOCKET_TRANSPORT, URING_TRANSPORT };
+
+// what a sender does when the mailbox of the receiver is full
+enum overflowPOLICY { OVERFLOW_DROP, OVERFLOW_SPIN };
+
 /**
  * CLASS NAME: Params
  *
@@ -23,6 +34,7 @@ public:
 	int MAX_NNB;                // max number of neighbors
 	int SINGLE_FAILURE;			// single/multi failure
 	double MSG_DROP_PROB;		// message drop probability
+	double MSG_CORRUPT_PROB;	// probability that a bit of a sent message is flipped
 	double STEP_RATE;		    // dictates the rate of insertion
 	int EN_GPSZ;			    // actual number of peers
 	int MAX_MSG_SIZE;
@@ -32,8 +44,29 @@ public:
 	int allNodesJoined;
 	short PORTNUM;
 	int CRUDTEST;
+	storageTYPE STORAGE_BACKEND;	// storage engine of every node's HashTable
+	char DATA_DIR[64];			// directory of the nodes' durable files
+	unsigned long MEMTABLE_SIZE;	// bytes buffered in memory before an SSTable flush
+	unsigned long VALUE_LOG_THRESHOLD;	// values this large are kept in a value log, 0 for none
+	unsigned long ROW_CACHE_SIZE;	// bytes of recently read records cached by each node, 0 for none
+	unsigned long MEMORY_BUDGET;	// bytes a node may hold before it rejects writes, 0 for unlimited
+	int STORAGE_SHARDS;			// independently locked parts of each HashTable
+	int WORKER_THREADS;			// threads serving a node's CRUD messages, 0 for inline
+	int COMMITLOG;				// write mutations through a commit log
+	syncPOLICY COMMITLOG_SYNC;
+	int COMMITLOG_PERIOD;		// time units between syncs with SYNC_PERIODIC
+	int SNAPSHOT;				// restore the nodes from their snapshots at startup
+	int SNAPSHOT_PERIOD;		// time units between automatic snapshots, 0 for none
+	int TOMBSTONE_GRACE;		// time units a delete is remembered, to repair replicas that missed it
+	int COMPRESSION;			// store values compressed when that makes them smaller
+	int COMPRESSION_MIN_SIZE;	// bytes below which values are stored as is
+	int NETWORK_CHECKSUM;		// append a CRC32C to every message and drop the corrupt ones
+	int MAILBOX_SIZE;			// messages in flight to one node, rounded up to a power of two
+	overflowPOLICY MAILBOX_OVERFLOW;
+	transportTYPE TRANSPORT;	// SOCKET: gossip over UDP and key value messages over TCP on 127.0.0.1; URING: the same through io_uring
 	Params();
 	void setparams(char *);
+	void setoption(char *name, char *value);
 	int getcurrtime();
 };
 
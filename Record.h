@@ -0,0 +1,145 @@
+/**********************************
+ * FILE NAME: Record.h
+ *
+ * DESCRIPTION: Encoding of the versioned values stored by the replicas
+ **********************************/
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "Coding.h"
+#include "LZCodec.h"
+#include <stdint.h>
+#include <string_view>
+
+/*
+ * Macros
+ */
+// [u64 timestamp][u8 flags]
+#define RECORD_HEADER 9
+// the key was deleted; the record has no value and is purged after TOMBSTONE_GRACE
+#define RECORD_TOMBSTONE 0x01
+// the header is followed by [u32 expiry], the globaltime at which the value expires
+#define RECORD_EXPIRES 0x02
+// the value is an LZCodec block
+#define RECORD_COMPRESSED 0x04
+
+/**
+ * CLASS NAME: Record
+ *
+ * DESCRIPTION: A value with the hybrid logical clock timestamp of the write that
+ * 				produced it. Stored in the HashTable as [u64 timestamp][u8 flags][value],
+ * 				or [u64 timestamp][u8 flags][u32 expiry][value] for a value with a TTL.
+ * 				value points into the decoded bytes, still compressed if so flagged. A delete is kept as a tombstone
+ * 				record, so that it replicates and wins over older writes like any other.
+ */
+class Record {
+public:
+	uint64_t timestamp;
+	uint8_t flags;
+	uint32_t expiry;
+	string_view value;
+	Record(): timestamp(0), flags(0), expiry(0) {}
+
+	/**
+	 * FUNCTION NAME: encode
+	 *
+	 * DESCRIPTION: Replaces out with the encoding of a record, expiring at expiry if not 0
+	 */
+	static void encode(string &out, uint64_t timestamp, uint8_t flags, string_view value, uint32_t expiry = 0) {
+		flags = expiry ? flags | RECORD_EXPIRES : flags & ~RECORD_EXPIRES;
+		out.clear();
+		out.reserve(RECORD_HEADER + 4 + value.size());
+		putU64(out, timestamp);
+		out.push_back((char)flags);
+		if ( expiry ) {
+			putU32(out, expiry);
+		}
+		out.append(value.data(), value.size());
+	}
+
+	/**
+	 * FUNCTION NAME: decode
+	 *
+	 * RETURNS:
+	 * true with *record set
+	 * false if bytes are too short to be a record
+	 */
+	static bool decode(string_view bytes, Record *record) {
+		if ( bytes.size() < RECORD_HEADER ) {
+			return false;
+		}
+		record->timestamp = getU64(bytes.data());
+		record->flags = (uint8_t)bytes[8];
+		record->expiry = 0;
+		size_t header = RECORD_HEADER;
+		if ( record->flags & RECORD_EXPIRES ) {
+			if ( bytes.size() < RECORD_HEADER + 4 ) {
+				return false;
+			}
+			record->expiry = getU32(bytes.data() + RECORD_HEADER);
+			header += 4;
+		}
+		record->value = bytes.substr(header);
+		return true;
+	}
+
+	/**
+	 * FUNCTION NAME: timestampOf
+	 *
+	 * DESCRIPTION: Reads only the timestamp of an encoded record (0 if malformed)
+	 */
+	static uint64_t timestampOf(string_view bytes) {
+		return bytes.size() < RECORD_HEADER ? 0 : getU64(bytes.data());
+	}
+
+	/**
+	 * FUNCTION NAME: isTombstone
+	 *
+	 * DESCRIPTION: Reads only the flags of an encoded record
+	 */
+	static bool isTombstone(string_view bytes) {
+		return bytes.size() >= RECORD_HEADER && (bytes[8] & RECORD_TOMBSTONE);
+	}
+
+	/**
+	 * FUNCTION NAME: unpack
+	 *
+	 * DESCRIPTION: Copies the value into *out, decompressing it if needed
+	 *
+	 * RETURNS:
+	 * false if a compressed value is corrupt
+	 */
+	bool unpack(string *out) {
+		if ( flags & RECORD_COMPRESSED ) {
+			return LZCodec::decompress(value, out);
+		}
+		out->assign(value.data(), value.size());
+		return true;
+	}
+
+	/**
+	 * FUNCTION NAME: isLive
+	 *
+	 * DESCRIPTION: Returns true if the record holds a value that has not expired by now
+	 */
+	bool isLive(uint32_t now) {
+		return !(flags & RECORD_TOMBSTONE) && (expiry == 0 || now < expiry);
+	}
+
+	/**
+	 * FUNCTION NAME: isLive
+	 *
+	 * DESCRIPTION: Same for an encoded record
+	 */
+	static bool isLive(string_view bytes, uint32_t now) {
+		Record record;
+		return decode(bytes, &record) && record.isLive(now);
+	}
+};
+
+#endif /* RECORD_H_ */
@@ -0,0 +1,263 @@
+/**********************************
+ * FILE NAME: RowCache.cpp
+ *
+ * DESCRIPTION: Definition of the cache of recently read records of a replica
+ **********************************/
+
+#include "RowCache.h"
+
+/**
+ * Constructor
+ *
+ * DESCRIPTION: Builds a cache of about capacity bytes, split evenly over the shards
+ */
+RowCache::RowCache(unsigned long capacity) {
+	size_t shardCapacity = capacity / CACHE_SHARDS;
+	windowCapacity = shardCapacity * CACHE_WINDOW_PERCENT / 100;
+	mainCapacity = shardCapacity - windowCapacity;
+	protectedCapacity = mainCapacity * CACHE_PROTECTED_PERCENT / 100;
+
+	// a word of 16 counters per entry the shard is expected to hold
+	size_t words = 64;
+	while ( words < shardCapacity / CACHE_ENTRY_ESTIMATE ) {
+		words <<= 1;
+	}
+	for ( int i = 0; i < CACHE_SHARDS; i++ ) {
+		Shard *shard = new Shard();
+		for ( int segment = WINDOW; segment <= PROTECTED; segment++ ) {
+			shard->bytes[segment] = 0;
+		}
+		shard->sketch.assign(words, 0);
+		shard->accesses = 0;
+		shard->sampleSize = words * SKETCH_SAMPLE_FACTOR;
+		shards.push_back(shard);
+	}
+}
+
+RowCache::~RowCache() {
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		delete shards[i];
+	}
+}
+
+/**
+ * FUNCTION NAME: hashOf
+ *
+ * DESCRIPTION: Returns a hash of the key with its entropy spread over all 64 bits
+ */
+uint64_t RowCache::hashOf(string_view key) {
+	std::hash<string_view> hashFunc;
+	return (uint64_t)hashFunc(key) * 0x9E3779B97F4A7C15ull;
+}
+
+/**
+ * FUNCTION NAME: countAccess
+ *
+ * DESCRIPTION: Increments the SKETCH_DEPTH counters of a key, each in a word and a nibble
+ * 				picked by a differently seeded hash. Every sampleSize accesses all counters
+ * 				are halved, so that the frequencies follow a changing workload.
+ */
+void RowCache::countAccess(Shard *shard, uint64_t hash) {
+	uint64_t mask = shard->sketch.size() - 1;
+	for ( int i = 0; i < SKETCH_DEPTH; i++ ) {
+		uint64_t probe = (hash + i * 0xBF58476D1CE4E5B9ull) * 0x94D049BB133111EBull;
+		uint64_t &word = shard->sketch[(probe >> 32) & mask];
+		int shift = ((probe >> 28) & 15) * 4;
+		if ( ((word >> shift) & 15) < 15 ) {
+			word += (uint64_t)1 << shift;
+		}
+	}
+	if ( ++shard->accesses < shard->sampleSize ) {
+		return;
+	}
+	for ( unsigned int i = 0; i < shard->sketch.size(); i++ ) {
+		shard->sketch[i] = (shard->sketch[i] >> 1) & 0x7777777777777777ull;
+	}
+	shard->accesses /= 2;
+}
+
+/**
+ * FUNCTION NAME: frequency
+ *
+ * DESCRIPTION: Returns the estimated number of recent accesses to the key: the smallest
+ * 				of its counters, which may only overestimate
+ */
+unsigned int RowCache::frequency(Shard *shard, string_view key) {
+	uint64_t hash = hashOf(key);
+	uint64_t mask = shard->sketch.size() - 1;
+	unsigned int count = 15;
+	for ( int i = 0; i < SKETCH_DEPTH; i++ ) {
+		uint64_t probe = (hash + i * 0xBF58476D1CE4E5B9ull) * 0x94D049BB133111EBull;
+		uint64_t word = shard->sketch[(probe >> 32) & mask];
+		count = min(count, (unsigned int)((word >> (((probe >> 28) & 15) * 4)) & 15));
+	}
+	return count;
+}
+
+/**
+ * FUNCTION NAME: move
+ *
+ * DESCRIPTION: Makes the entry the most recently used one of segment
+ */
+void RowCache::move(Shard *shard, list<Entry>::iterator entry, Segment segment) {
+	shard->bytes[entry->segment] -= entry->charge;
+	shard->bytes[segment] += entry->charge;
+	shard->lists[segment].splice(shard->lists[segment].begin(), shard->lists[entry->segment], entry);
+	entry->segment = segment;
+}
+
+/**
+ * FUNCTION NAME: remove
+ *
+ * DESCRIPTION: Drops the entry from the shard
+ */
+void RowCache::remove(Shard *shard, list<Entry>::iterator entry) {
+	shard->bytes[entry->segment] -= entry->charge;
+	shard->index.erase(entry->key);
+	shard->lists[entry->segment].erase(entry);
+}
+
+/**
+ * FUNCTION NAME: admit
+ *
+ * DESCRIPTION: Moves the least recently used entry of the window into probation.
+ * 				While the main cache is then too big, the candidate and the least
+ * 				recently used entry of the main cache, the victim, compete: the less
+ * 				frequently accessed one is dropped, the victim on a tie.
+ */
+void RowCache::admit(Shard *shard) {
+	list<Entry> &probation = shard->lists[PROBATION];
+	list<Entry> &protect = shard->lists[PROTECTED];
+	list<Entry>::iterator candidate = prev(shard->lists[WINDOW].end());
+
+	move(shard, candidate, PROBATION);
+	while ( shard->bytes[PROBATION] + shard->bytes[PROTECTED] > mainCapacity ) {
+		list<Entry>::iterator victim;
+		if ( prev(probation.end()) != candidate ) {
+			victim = prev(probation.end());
+		}
+		else if ( !protect.empty() ) {
+			victim = prev(protect.end());
+		}
+		else {
+			victim = candidate;
+		}
+		if ( victim != candidate && frequency(shard, candidate->key) > frequency(shard, victim->key) ) {
+			remove(shard, victim);
+			shard->stats.evictions++;
+		}
+		else {
+			remove(shard, candidate);
+			shard->stats.rejections++;
+			return;
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Copies the cached value of the key into *value. Hit or miss, the access
+ * 				is counted in the frequency sketch; a hit in probation promotes the entry
+ * 				to protected, demoting the least recently used protected entries if needed.
+ *
+ * RETURNS:
+ * true on a hit
+ * false on a miss
+ */
+bool RowCache::get(string_view key, string *value) {
+	uint64_t hash = hashOf(key);
+	Shard *shard = shards[hash % CACHE_SHARDS];
+	lock_guard<mutex> guard(shard->lock);
+
+	countAccess(shard, hash);
+	auto found = shard->index.find(string(key));
+	if ( found == shard->index.end() ) {
+		shard->stats.misses++;
+		return false;
+	}
+	shard->stats.hits++;
+	list<Entry>::iterator entry = found->second;
+	if ( entry->segment == PROBATION ) {
+		move(shard, entry, PROTECTED);
+		while ( shard->bytes[PROTECTED] > protectedCapacity ) {
+			move(shard, prev(shard->lists[PROTECTED].end()), PROBATION);
+		}
+	}
+	else {
+		move(shard, entry, entry->segment);
+	}
+	value->assign(entry->value);
+	return true;
+}
+
+/**
+ * FUNCTION NAME: put
+ *
+ * DESCRIPTION: Caches the value of the key, typically just read after a miss.
+ * 				The entry starts in the window, then has to be admitted into the main cache.
+ * 				A key already cached starts over with the new value.
+ */
+void RowCache::put(string_view key, string_view value) {
+	uint64_t hash = hashOf(key);
+	Shard *shard = shards[hash % CACHE_SHARDS];
+	size_t charge = key.size() + value.size() + CACHE_ENTRY_OVERHEAD;
+	lock_guard<mutex> guard(shard->lock);
+
+	auto found = shard->index.find(string(key));
+	if ( found != shard->index.end() ) {
+		remove(shard, found->second);
+	}
+	if ( charge > mainCapacity ) {
+		shard->stats.rejections++;
+		return;
+	}
+
+	Entry entry;
+	entry.key.assign(key.data(), key.size());
+	entry.value.assign(value.data(), value.size());
+	entry.segment = WINDOW;
+	entry.charge = charge;
+	shard->lists[WINDOW].push_front(std::move(entry));
+	shard->bytes[WINDOW] += charge;
+	shard->index[shard->lists[WINDOW].front().key] = shard->lists[WINDOW].begin();
+
+	while ( shard->bytes[WINDOW] > windowCapacity ) {
+		admit(shard);
+	}
+}
+
+/**
+ * FUNCTION NAME: invalidate
+ *
+ * DESCRIPTION: Drops the key from the cache, if there
+ */
+void RowCache::invalidate(string_view key) {
+	Shard *shard = shards[hashOf(key) % CACHE_SHARDS];
+	lock_guard<mutex> guard(shard->lock);
+
+	auto found = shard->index.find(string(key));
+	if ( found != shard->index.end() ) {
+		remove(shard, found->second);
+	}
+}
+
+/**
+ * FUNCTION NAME: stats
+ *
+ * DESCRIPTION: Returns the counters of all shards added up
+ */
+CacheStats RowCache::stats() {
+	CacheStats total;
+	for ( unsigned int i = 0; i < shards.size(); i++ ) {
+		Shard *shard = shards[i];
+		lock_guard<mutex> guard(shard->lock);
+		total.hits += shard->stats.hits;
+		total.misses += shard->stats.misses;
+		total.evictions += shard->stats.evictions;
+		total.rejections += shard->stats.rejections;
+		total.entries += shard->index.size();
+		total.bytes += shard->bytes[WINDOW] + shard->bytes[PROBATION] + shard->bytes[PROTECTED];
+	}
+	return total;
+}
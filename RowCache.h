@@ -0,0 +1,111 @@
+/**********************************
+ * FILE NAME: RowCache.h
+ *
+ * DESCRIPTION: Header file of the cache of recently read records of a replica
+ **********************************/
+
+#ifndef ROWCACHE_H_
+#define ROWCACHE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+#include <string_view>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+
+/*
+ * Macros
+ */
+#define CACHE_SHARDS 16
+// share of a shard's bytes given to the admission window, the rest is the main cache
+#define CACHE_WINDOW_PERCENT 1
+// share of the main cache given to entries hit at least twice
+#define CACHE_PROTECTED_PERCENT 80
+// bytes charged per entry on top of its key and value (list and index nodes)
+#define CACHE_ENTRY_OVERHEAD 64
+// entry size assumed to size the frequency sketch
+#define CACHE_ENTRY_ESTIMATE 256
+// counters of the frequency sketch read per key
+#define SKETCH_DEPTH 4
+// the sketch counts are halved after this many accesses per sketch counter word
+#define SKETCH_SAMPLE_FACTOR 10
+
+/**
+ * CLASS NAME: CacheStats
+ *
+ * DESCRIPTION: Counters of a RowCache
+ */
+class CacheStats {
+public:
+	unsigned long hits;
+	unsigned long misses;
+	// entries dropped to make room, and new entries refused by the admission policy
+	unsigned long evictions;
+	unsigned long rejections;
+	unsigned long entries;
+	unsigned long bytes;
+	CacheStats(): hits(0), misses(0), evictions(0), rejections(0), entries(0), bytes(0) {}
+};
+
+/**
+ * CLASS NAME: RowCache
+ *
+ * DESCRIPTION: Bounded cache of key to value pairs with the W-TinyLFU policy (as in Caffeine).
+ * 				A new entry enters a small LRU window; once pushed out of it, it is only
+ * 				admitted into the main cache if it was accessed more often than the entry
+ * 				it would replace, according to a count-min sketch of 4 bit counters that
+ * 				are halved periodically. A scan reading many keys once therefore cycles
+ * 				through the window without evicting the hot keys.
+ * 				The main cache is a segmented LRU: probation, and protected for the
+ * 				entries hit again while in probation.
+ * 				Keys are spread over CACHE_SHARDS shards, each one behind its own lock.
+ * 				The cache never reads the store: callers put what they read and
+ * 				invalidate what they write.
+ */
+class RowCache {
+private:
+	enum Segment { WINDOW, PROBATION, PROTECTED };
+	class Entry {
+	public:
+		string key;
+		string value;
+		Segment segment;
+		size_t charge;
+	};
+	class Shard {
+	public:
+		mutex lock;
+		// most recently used first
+		list<Entry> lists[3];
+		size_t bytes[3];
+		unordered_map<string, list<Entry>::iterator> index;
+		// 16 counters of 4 bits per word
+		vector<uint64_t> sketch;
+		uint64_t accesses;
+		uint64_t sampleSize;
+		CacheStats stats;
+	};
+	vector<Shard *> shards;
+	size_t windowCapacity;
+	size_t mainCapacity;
+	size_t protectedCapacity;
+	static uint64_t hashOf(string_view key);
+	void countAccess(Shard *shard, uint64_t hash);
+	unsigned int frequency(Shard *shard, string_view key);
+	void move(Shard *shard, list<Entry>::iterator entry, Segment segment);
+	void remove(Shard *shard, list<Entry>::iterator entry);
+	void admit(Shard *shard);
+public:
+	RowCache(unsigned long capacity);
+	bool get(string_view key, string *value);
+	void put(string_view key, string_view value);
+	void invalidate(string_view key);
+	CacheStats stats();
+	virtual ~RowCache();
+};
+
+#endif /* ROWCACHE_H_ */
@@ -0,0 +1,394 @@
+/**********************************
+ * FILE NAME: SSTable.cpp
+ *
+ * DESCRIPTION: Definition of the immutable sorted tables of the LSM engine
+ **********************************/
+
+#include "SSTable.h"
+#include "Coding.h"
+
+#define ENTRY_HEADER 8
+#define FOOTER_SIZE 32
+// high bit of the value length marks a tombstone
+#define DELETED_BIT 0x80000000u
+
+/**
+ * Constructor
+ */
+MergeSource::MergeSource(vector<EntrySource *> sources): sources(sources), current(-1) {
+	pick();
+}
+
+/**
+ * Destructor
+ */
+MergeSource::~MergeSource() {
+	for ( unsigned int i = 0; i < sources.size(); i++ ) {
+		delete sources[i];
+	}
+}
+
+/**
+ * FUNCTION NAME: pick
+ *
+ * DESCRIPTION: Points current at the source holding the smallest key.
+ * 				On ties the earlier (newer) source wins.
+ */
+void MergeSource::pick() {
+	current = -1;
+	for ( unsigned int i = 0; i < sources.size(); i++ ) {
+		if ( sources[i]->valid() && (current < 0 || sources[i]->key() < sources[current]->key()) ) {
+			current = i;
+		}
+	}
+}
+
+bool MergeSource::valid() {
+	return current >= 0;
+}
+
+string_view MergeSource::key() {
+	return sources[current]->key();
+}
+
+string_view MergeSource::value() {
+	return sources[current]->value();
+}
+
+bool MergeSource::deleted() {
+	return sources[current]->deleted();
+}
+
+/**
+ * FUNCTION NAME: next
+ *
+ * DESCRIPTION: Skips the older versions of the current key, then moves to the next key
+ */
+void MergeSource::next() {
+	for ( unsigned int i = 0; i < sources.size(); i++ ) {
+		if ( (int)i != current && sources[i]->valid() && sources[i]->key() == sources[current]->key() ) {
+			sources[i]->next();
+		}
+	}
+	// advanced last: the other sources were compared against its key
+	sources[current]->next();
+	pick();
+}
+
+/**
+ * Constructor
+ */
+SSTable::Iterator::Iterator(int fd, uint64_t end): fd(fd), pos(0), end(end), bufferStart(0), isDeleted(false), isValid(false) {
+	load();
+}
+
+/**
+ * FUNCTION NAME: fill
+ *
+ * DESCRIPTION: Makes sure bytes [offset, offset + size) are in the buffer,
+ * 				reading at least SSTABLE_READ_CHUNK bytes when it has to read
+ */
+bool SSTable::Iterator::fill(uint64_t offset, size_t size) {
+	if ( offset >= bufferStart && offset + size <= bufferStart + buffer.size() ) {
+		return true;
+	}
+	size_t length = size > SSTABLE_READ_CHUNK ? size : SSTABLE_READ_CHUNK;
+	if ( offset + length > end ) {
+		length = end - offset;
+	}
+	if ( length < size ) {
+		return false;
+	}
+	buffer.resize(length);
+	bufferStart = offset;
+	return pread(fd, &buffer[0], length, offset) == (ssize_t)length;
+}
+
+/**
+ * FUNCTION NAME: load
+ *
+ * DESCRIPTION: Decodes the entry at pos
+ */
+void SSTable::Iterator::load() {
+	isValid = false;
+	if ( pos >= end || !fill(pos, ENTRY_HEADER) ) {
+		return;
+	}
+	uint32_t keySize = getU32(buffer.data() + (pos - bufferStart));
+	uint32_t valueField = getU32(buffer.data() + (pos - bufferStart) + 4);
+	uint32_t valueSize = valueField & ~DELETED_BIT;
+	if ( !fill(pos, ENTRY_HEADER + keySize + valueSize) ) {
+		return;
+	}
+	const char *entry = buffer.data() + (pos - bufferStart);
+	currentKey = string_view(entry + ENTRY_HEADER, keySize);
+	currentValue = string_view(entry + ENTRY_HEADER + keySize, valueSize);
+	isDeleted = (valueField & DELETED_BIT) != 0;
+	isValid = true;
+}
+
+bool SSTable::Iterator::valid() {
+	return isValid;
+}
+
+string_view SSTable::Iterator::key() {
+	return currentKey;
+}
+
+string_view SSTable::Iterator::value() {
+	return currentValue;
+}
+
+bool SSTable::Iterator::deleted() {
+	return isDeleted;
+}
+
+void SSTable::Iterator::next() {
+	pos += ENTRY_HEADER + currentKey.size() + currentValue.size();
+	load();
+}
+
+/**
+ * Constructor
+ */
+SSTable::SSTable(string path, uint64_t firstSeq, uint64_t lastSeq): path(path), firstSeq(firstSeq), lastSeq(lastSeq), fd(-1), dataEnd(0), entries(0) {}
+
+/**
+ * Destructor
+ */
+SSTable::~SSTable() {
+	if ( fd >= 0 ) {
+		close(fd);
+	}
+}
+
+/**
+ * FUNCTION NAME: open
+ *
+ * DESCRIPTION: Opens the file and loads its sparse index and bloom filter. A filter
+ * 				written by an older version answers maybe for every key.
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int SSTable::open() {
+	fd = ::open(path.c_str(), O_RDONLY);
+	if ( fd < 0 ) {
+		return FAILURE;
+	}
+	off_t fileSize = lseek(fd, 0, SEEK_END);
+	char footer[FOOTER_SIZE];
+	if ( fileSize < FOOTER_SIZE || pread(fd, footer, FOOTER_SIZE, fileSize - FOOTER_SIZE) != FOOTER_SIZE
+			|| getU32(footer + 24) != SSTABLE_MAGIC ) {
+		return FAILURE;
+	}
+	dataEnd = getU64(footer);
+	uint64_t bloomOffset = getU64(footer + 8);
+	entries = getU64(footer + 16);
+	if ( dataEnd > bloomOffset || bloomOffset > (uint64_t)fileSize - FOOTER_SIZE ) {
+		return FAILURE;
+	}
+	uint32_t version = getU32(footer + 28);
+
+	string meta(fileSize - FOOTER_SIZE - dataEnd, '\0');
+	if ( pread(fd, &meta[0], meta.size(), dataEnd) != (ssize_t)meta.size() ) {
+		return FAILURE;
+	}
+	// every index entry [u32 key size][key][u64 offset] must end before the bloom filter
+	const char *p = meta.data(), *indexEnd = meta.data() + (bloomOffset - dataEnd);
+	if ( indexEnd - p < 4 ) {
+		return FAILURE;
+	}
+	uint32_t count = getU32(p);
+	p += 4;
+	if ( count > (uint64_t)(indexEnd - p) / 12 ) {
+		return FAILURE;
+	}
+	index.reserve(count);
+	for ( uint32_t i = 0; i < count; i++ ) {
+		if ( indexEnd - p < 4 ) {
+			return FAILURE;
+		}
+		uint32_t keySize = getU32(p);
+		if ( (uint64_t)(indexEnd - p - 4) < (uint64_t)keySize + 8 ) {
+			return FAILURE;
+		}
+		index.emplace_back(string(p + 4, keySize), getU64(p + 4 + keySize));
+		p += 4 + keySize + 8;
+	}
+	if ( !bloom.deserialize(indexEnd, meta.size() - (bloomOffset - dataEnd)) ) {
+		return FAILURE;
+	}
+	if ( version < SSTABLE_VERSION ) {
+		bloom.disable();
+	}
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: mayContain
+ *
+ * DESCRIPTION: Asks the in-memory bloom filter; never touches the file
+ */
+bool SSTable::mayContain(string_view key) {
+	return bloom.mayContain(key);
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Looks the key up. A negative bloom filter answer costs no I/O,
+ * 				otherwise one pread of the INDEX_INTERVAL entries that may hold the key.
+ *
+ * RETURNS:
+ * KEY_FOUND with *value set, KEY_DELETED for a tombstone, KEY_ABSENT otherwise
+ */
+lookupRESULT SSTable::get(string_view key, string *value) {
+	if ( !bloom.mayContain(key) ) {
+		return KEY_ABSENT;
+	}
+	// last block whose first key is <= key
+	vector<pair<string, uint64_t> >::iterator block = upper_bound(index.begin(), index.end(), key,
+			[](string_view k, const pair<string, uint64_t> &e) { return k < string_view(e.first); });
+	if ( block == index.begin() ) {
+		return KEY_ABSENT;
+	}
+	block--;
+	uint64_t start = block->second;
+	uint64_t stop = (block + 1 == index.end()) ? dataEnd : (block + 1)->second;
+
+	string bytes(stop - start, '\0');
+	if ( pread(fd, &bytes[0], bytes.size(), start) != (ssize_t)bytes.size() ) {
+		return KEY_ABSENT;
+	}
+	size_t pos = 0;
+	while ( pos + ENTRY_HEADER <= bytes.size() ) {
+		uint32_t keySize = getU32(bytes.data() + pos);
+		uint32_t valueField = getU32(bytes.data() + pos + 4);
+		uint32_t valueSize = valueField & ~DELETED_BIT;
+		string_view entryKey(bytes.data() + pos + ENTRY_HEADER, keySize);
+		if ( entryKey == key ) {
+			if ( valueField & DELETED_BIT ) {
+				return KEY_DELETED;
+			}
+			if ( value ) {
+				value->assign(bytes.data() + pos + ENTRY_HEADER + keySize, valueSize);
+			}
+			return KEY_FOUND;
+		}
+		if ( entryKey > key ) {
+			break;
+		}
+		pos += ENTRY_HEADER + keySize + valueSize;
+	}
+	return KEY_ABSENT;
+}
+
+/**
+ * FUNCTION NAME: newIterator
+ *
+ * DESCRIPTION: Returns a cursor reading the data entries sequentially. Caller deletes it.
+ */
+EntrySource *SSTable::newIterator() {
+	return new Iterator(fd, dataEnd);
+}
+
+/**
+ * FUNCTION NAME: write
+ *
+ * DESCRIPTION: Writes the entries of source into a new table at path.
+ * 				The file is built under a temporary name, synced and renamed into place.
+ * 				With dropDeleted the tombstones are left out (only safe when no older table remains).
+ *
+ * RETURNS:
+ * SUCCESS, with the number of entries in *written; no file is left behind when it is 0
+ * FAILURE otherwise
+ */
+int SSTable::write(string path, EntrySource *source, uint64_t expectedEntries, bool dropDeleted, uint64_t *written) {
+	string tmpPath = path + ".tmp";
+	FILE *out = fopen(tmpPath.c_str(), "wb");
+	*written = 0;
+	if ( out == NULL ) {
+		return FAILURE;
+	}
+
+	BloomFilter filter;
+	filter.init(expectedEntries);
+	string indexBytes, entry;
+	uint32_t indexCount = 0;
+	uint64_t offset = 0, count = 0;
+
+	for ( ; source->valid(); source->next() ) {
+		if ( dropDeleted && source->deleted() ) {
+			continue;
+		}
+		string_view key = source->key();
+		string_view value = source->deleted() ? string_view() : source->value();
+		if ( count % INDEX_INTERVAL == 0 ) {
+			putU32(indexBytes, (uint32_t)key.size());
+			indexBytes.append(key.data(), key.size());
+			putU64(indexBytes, offset);
+			indexCount++;
+		}
+		filter.add(key);
+
+		entry.clear();
+		putU32(entry, (uint32_t)key.size());
+		putU32(entry, (uint32_t)value.size() | (source->deleted() ? DELETED_BIT : 0));
+		entry.append(key.data(), key.size());
+		entry.append(value.data(), value.size());
+		fwrite(entry.data(), 1, entry.size(), out);
+		offset += entry.size();
+		count++;
+	}
+
+	string meta;
+	putU32(meta, indexCount);
+	meta.append(indexBytes);
+	uint64_t bloomOffset = offset + meta.size();
+	filter.serialize(meta);
+	putU64(meta, offset);
+	putU64(meta, bloomOffset);
+	putU64(meta, count);
+	putU32(meta, SSTABLE_MAGIC);
+	putU32(meta, SSTABLE_VERSION);
+	fwrite(meta.data(), 1, meta.size(), out);
+
+	bool ok = fflush(out) == 0 && fsync(fileno(out)) == 0;
+	fclose(out);
+	if ( !ok || count == 0 || rename(tmpPath.c_str(), path.c_str()) != 0 ) {
+		unlink(tmpPath.c_str());
+		return ok && count == 0 ? SUCCESS : FAILURE;
+	}
+	*written = count;
+	return SUCCESS;
+}
+
+uint64_t SSTable::getFirstSeq() {
+	return firstSeq;
+}
+
+uint64_t SSTable::getLastSeq() {
+	return lastSeq;
+}
+
+uint64_t SSTable::getEntries() {
+	return entries;
+}
+
+string SSTable::getPath() {
+	return path;
+}
+
+/**
+ * FUNCTION NAME: memoryBytes
+ *
+ * DESCRIPTION: Returns the memory held by the sparse index and the bloom filter
+ */
+size_t SSTable::memoryBytes() {
+	size_t bytes = bloom.memoryBytes();
+	for ( unsigned int i = 0; i < index.size(); i++ ) {
+		bytes += sizeof(index[i]) + index[i].first.capacity();
+	}
+	return bytes;
+}
@@ -0,0 +1,124 @@
+/**********************************
+ * FILE NAME: SSTable.h
+ *
+ * DESCRIPTION: Header file of the immutable sorted tables of the LSM engine
+ **********************************/
+
+#ifndef SSTABLE_H_
+#define SSTABLE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "BloomFilter.h"
+#include <stdint.h>
+#include <string_view>
+
+/*
+ * Macros
+ */
+// one sparse index entry every INDEX_INTERVAL data entries
+#define INDEX_INTERVAL 16
+#define SSTABLE_MAGIC 0x53535431
+// footer version; the bloom filters of version 0 files were hashed with std::hash and are ignored
+#define SSTABLE_VERSION 1
+// size of the sequential reads done by iterators
+#define SSTABLE_READ_CHUNK 65536
+
+// outcome of a lookup in one layer of the LSM tree
+enum lookupRESULT { KEY_ABSENT, KEY_FOUND, KEY_DELETED };
+
+/**
+ * CLASS NAME: EntrySource
+ *
+ * DESCRIPTION: Cursor over entries sorted by key. Deleted entries are the tombstones
+ * 				that hide older versions. key() and value() stay valid until next().
+ */
+class EntrySource {
+public:
+	virtual ~EntrySource() {}
+	virtual bool valid() = 0;
+	virtual string_view key() = 0;
+	virtual string_view value() = 0;
+	virtual bool deleted() = 0;
+	virtual void next() = 0;
+};
+
+/**
+ * CLASS NAME: MergeSource
+ *
+ * DESCRIPTION: Merges sources ordered newest first, yielding only the newest entry of each key
+ */
+class MergeSource : public EntrySource {
+private:
+	vector<EntrySource *> sources;
+	int current;
+	void pick();
+public:
+	MergeSource(vector<EntrySource *> sources);
+	bool valid();
+	string_view key();
+	string_view value();
+	bool deleted();
+	void next();
+	virtual ~MergeSource();
+};
+
+/**
+ * CLASS NAME: SSTable
+ *
+ * DESCRIPTION: Immutable file of entries sorted by key.
+ * 				Layout: data entries [u32 key length][u32 value length | deleted bit][key][value],
+ * 				sparse index [u32 count]([u32 key length][key][u64 offset])*, bloom filter,
+ * 				footer [u64 index offset][u64 bloom offset][u64 entries][u32 magic][u32 version].
+ * 				The index and the bloom filter are kept in memory once opened.
+ */
+class SSTable {
+private:
+	class Iterator : public EntrySource {
+	private:
+		int fd;
+		uint64_t pos;
+		uint64_t end;
+		string buffer;
+		uint64_t bufferStart;
+		string_view currentKey;
+		string_view currentValue;
+		bool isDeleted;
+		bool isValid;
+		bool fill(uint64_t offset, size_t size);
+		void load();
+	public:
+		Iterator(int fd, uint64_t end);
+		bool valid();
+		string_view key();
+		string_view value();
+		bool deleted();
+		void next();
+	};
+	string path;
+	// range of memtable flushes merged into this table
+	uint64_t firstSeq;
+	uint64_t lastSeq;
+	int fd;
+	uint64_t dataEnd;
+	uint64_t entries;
+	vector<pair<string, uint64_t> > index;
+	BloomFilter bloom;
+public:
+	SSTable(string path, uint64_t firstSeq, uint64_t lastSeq);
+	int open();
+	bool mayContain(string_view key);
+	lookupRESULT get(string_view key, string *value);
+	EntrySource *newIterator();
+	static int write(string path, EntrySource *source, uint64_t expectedEntries, bool dropDeleted, uint64_t *written);
+	uint64_t getFirstSeq();
+	uint64_t getLastSeq();
+	uint64_t getEntries();
+	string getPath();
+	size_t memoryBytes();
+	virtual ~SSTable();
+};
+
+#endif /* SSTABLE_H_ */
@@ -0,0 +1,207 @@
+/**********************************
+ * FILE NAME: SlabArena.cpp
+ *
+ * DESCRIPTION: Definition of the slab allocator used by the storage engines
+ **********************************/
+
+#include "SlabArena.h"
+
+/**
+ * Constructor
+ */
+SlabArena::SlabArena(): cursor(NULL), limit(NULL), large(NULL) {
+	memset(freeLists, 0, sizeof(freeLists));
+}
+
+/**
+ * Destructor
+ */
+SlabArena::~SlabArena() {
+	releaseAll();
+}
+
+/**
+ * FUNCTION NAME: sizeClass
+ *
+ * RETURNS:
+ * index of the smallest size class holding size bytes
+ * -1 if size is above MAX_CHUNK
+ */
+int SlabArena::sizeClass(size_t size) {
+	if ( size > MAX_CHUNK ) {
+		return -1;
+	}
+	int index = 0;
+	size_t chunk = MIN_CHUNK;
+	while ( chunk < size ) {
+		chunk <<= 1;
+		index++;
+	}
+	return index;
+}
+
+/**
+ * FUNCTION NAME: chunkSize
+ *
+ * RETURNS:
+ * number of bytes actually reserved for an allocation of size bytes
+ */
+size_t SlabArena::chunkSize(size_t size) {
+	int index = sizeClass(size);
+	if ( index < 0 ) {
+		return size;
+	}
+	return (size_t)MIN_CHUNK << index;
+}
+
+/**
+ * FUNCTION NAME: addSlab
+ *
+ * DESCRIPTION: Starts carving chunks from a new slab
+ */
+void SlabArena::addSlab() {
+	char *slab = (char *)malloc(SLAB_SIZE);
+	slabs.push_back(slab);
+	cursor = slab;
+	limit = slab + SLAB_SIZE;
+	stats.bytesReserved += SLAB_SIZE;
+}
+
+/**
+ * FUNCTION NAME: allocate
+ *
+ * DESCRIPTION: Returns a chunk of at least size bytes, 16-byte aligned
+ */
+char *SlabArena::allocate(size_t size) {
+	int index = sizeClass(size);
+	stats.bytesUsed += size;
+
+	if ( index < 0 ) {
+		LargeChunk *chunk = (LargeChunk *)malloc(sizeof(LargeChunk) + size);
+		chunk->prev = NULL;
+		chunk->next = large;
+		chunk->size = size;
+		if ( large ) {
+			large->prev = chunk;
+		}
+		large = chunk;
+		stats.bytesReserved += sizeof(LargeChunk) + size;
+		return (char *)(chunk + 1);
+	}
+
+	if ( freeLists[index] ) {
+		FreeChunk *chunk = freeLists[index];
+		freeLists[index] = chunk->next;
+		return (char *)chunk;
+	}
+
+	size_t bytes = (size_t)MIN_CHUNK << index;
+	if ( cursor == NULL || (size_t)(limit - cursor) < bytes ) {
+		// the tail of the old slab is left unused
+		addSlab();
+	}
+	char *chunk = cursor;
+	cursor += bytes;
+	return chunk;
+}
+
+/**
+ * FUNCTION NAME: deallocate
+ *
+ * DESCRIPTION: Returns a chunk obtained from allocate(size) to its size class
+ */
+void SlabArena::deallocate(void *chunk, size_t size) {
+	int index = sizeClass(size);
+	stats.bytesUsed -= size;
+
+	if ( index < 0 ) {
+		LargeChunk *header = (LargeChunk *)chunk - 1;
+		if ( header->prev ) {
+			header->prev->next = header->next;
+		}
+		else {
+			large = header->next;
+		}
+		if ( header->next ) {
+			header->next->prev = header->prev;
+		}
+		stats.bytesReserved -= sizeof(LargeChunk) + header->size;
+		free(header);
+		return;
+	}
+
+	FreeChunk *freed = (FreeChunk *)chunk;
+	freed->next = freeLists[index];
+	freeLists[index] = freed;
+}
+
+/**
+ * FUNCTION NAME: reallocate
+ *
+ * DESCRIPTION: Resizes a chunk, keeping its first min(oldSize, newSize) bytes.
+ * 				The chunk stays in place while the new size fits its size class.
+ */
+char *SlabArena::reallocate(char *chunk, size_t oldSize, size_t newSize) {
+	int index = sizeClass(oldSize);
+	if ( index >= 0 && index == sizeClass(newSize) ) {
+		stats.bytesUsed += newSize;
+		stats.bytesUsed -= oldSize;
+		return chunk;
+	}
+	char *moved = allocate(newSize);
+	memcpy(moved, chunk, oldSize < newSize ? oldSize : newSize);
+	deallocate(chunk, oldSize);
+	return moved;
+}
+
+/**
+ * FUNCTION NAME: releaseAll
+ *
+ * DESCRIPTION: Gives every slab and large chunk back to the system
+ */
+void SlabArena::releaseAll() {
+	for ( unsigned int i = 0; i < slabs.size(); i++ ) {
+		free(slabs[i]);
+	}
+	slabs.clear();
+	while ( large ) {
+		LargeChunk *next = large->next;
+		free(large);
+		large = next;
+	}
+	cursor = NULL;
+	limit = NULL;
+	memset(freeLists, 0, sizeof(freeLists));
+	stats = ArenaStats();
+}
+
+/**
+ * FUNCTION NAME: reset
+ *
+ * DESCRIPTION: Drops all chunks at once. Cost is per slab, not per chunk,
+ * 				and the first slab is kept for the allocations that follow.
+ */
+void SlabArena::reset() {
+	char *first = NULL;
+	if ( !slabs.empty() ) {
+		first = slabs[0];
+		slabs[0] = slabs.back();
+		slabs.pop_back();
+	}
+	releaseAll();
+	if ( first ) {
+		slabs.push_back(first);
+		cursor = first;
+		limit = first + SLAB_SIZE;
+		stats.bytesReserved = SLAB_SIZE;
+	}
+}
+
+/**
+ * FUNCTION NAME: getStats
+ *
+ * DESCRIPTION: Returns bytes used versus bytes reserved
+ */
+ArenaStats SlabArena::getStats() {
+	return stats;
+}
@@ -0,0 +1,110 @@
+/**********************************
+ * FILE NAME: SlabArena.h
+ *
+ * DESCRIPTION: Header file of the slab allocator used by the storage engines
+ **********************************/
+
+#ifndef SLABARENA_H_
+#define SLABARENA_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+
+/*
+ * Macros
+ */
+#define SLAB_SIZE 65536
+#define MIN_CHUNK 16
+// chunks of 16, 32, ... 4096 bytes come from slabs, bigger ones from malloc
+#define NUM_SIZE_CLASSES 9
+#define MAX_CHUNK (MIN_CHUNK << (NUM_SIZE_CLASSES - 1))
+
+/**
+ * CLASS NAME: ArenaStats
+ *
+ * DESCRIPTION: Memory usage of one arena
+ */
+class ArenaStats {
+public:
+	// bytes requested by live allocations
+	unsigned long bytesUsed;
+	// bytes held from the system (slabs and large chunks)
+	unsigned long bytesReserved;
+	ArenaStats(): bytesUsed(0), bytesReserved(0) {}
+};
+
+/**
+ * CLASS NAME: SlabArena
+ *
+ * DESCRIPTION: Size-class allocator for key and value bytes.
+ * 				Small chunks are carved out of SLAB_SIZE slabs and recycled through one
+ * 				free list per size class, so steady-state inserts never reach malloc.
+ * 				reset() drops every chunk at once without visiting them.
+ */
+class SlabArena {
+private:
+	class FreeChunk {
+	public:
+		FreeChunk *next;
+	};
+	// padded to 32 bytes, so that the chunk right after it keeps malloc's 16-byte alignment
+	class alignas(16) LargeChunk {
+	public:
+		LargeChunk *prev;
+		LargeChunk *next;
+		size_t size;
+	};
+	vector<char *> slabs;
+	char *cursor;
+	char *limit;
+	FreeChunk *freeLists[NUM_SIZE_CLASSES];
+	LargeChunk *large;
+	ArenaStats stats;
+
+	static int sizeClass(size_t size);
+	void addSlab();
+	void releaseAll();
+public:
+	SlabArena();
+	char *allocate(size_t size);
+	void deallocate(void *chunk, size_t size);
+	char *reallocate(char *chunk, size_t oldSize, size_t newSize);
+	static size_t chunkSize(size_t size);
+	void reset();
+	ArenaStats getStats();
+	virtual ~SlabArena();
+};
+
+/**
+ * CLASS NAME: ArenaAllocator
+ *
+ * DESCRIPTION: STL allocator drawing from a SlabArena, used for the nodes of node-based containers
+ */
+template <class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	SlabArena *arena;
+	ArenaAllocator(SlabArena *arena): arena(arena) {}
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U> &another): arena(another.arena) {}
+	T *allocate(size_t n) {
+		return (T *)arena->allocate(n * sizeof(T));
+	}
+	void deallocate(T *p, size_t n) {
+		arena->deallocate(p, n * sizeof(T));
+	}
+	template <class U>
+	bool operator ==(const ArenaAllocator<U> &another) const {
+		return arena == another.arena;
+	}
+	template <class U>
+	bool operator !=(const ArenaAllocator<U> &another) const {
+		return arena != another.arena;
+	}
+};
+
+#endif /* SLABARENA_H_ */
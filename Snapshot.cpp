@@ -0,0 +1,261 @@
+/**********************************
+ * FILE NAME: Snapshot.cpp
+ *
+ * DESCRIPTION: Definition of the memory-mapped snapshot of a node's key space
+ **********************************/
+
+#include "Snapshot.h"
+#include "Coding.h"
+#include <sys/mman.h>
+
+#define ENTRY_HEADER 8
+
+/**
+ * FUNCTION NAME: pageAlign
+ *
+ * DESCRIPTION: Rounds offset up to the next page boundary
+ */
+static uint64_t pageAlign(uint64_t offset) {
+	return (offset + SNAPSHOT_PAGE - 1) / SNAPSHOT_PAGE * SNAPSHOT_PAGE;
+}
+
+/**
+ * FUNCTION NAME: writeAll
+ *
+ * DESCRIPTION: Writes all of bytes at offset
+ *
+ * RETURNS:
+ * true on SUCCESS
+ */
+static bool writeAll(int fd, const string &bytes, uint64_t offset) {
+	size_t written = 0;
+	while ( written < bytes.size() ) {
+		ssize_t n = pwrite(fd, bytes.data() + written, bytes.size() - written, offset + written);
+		if ( n < 0 ) {
+			return false;
+		}
+		written += n;
+	}
+	return true;
+}
+
+/**
+ * Constructor
+ */
+Snapshot::Snapshot(string path): path(path), base(NULL), length(0), entries(0), index(NULL), newest(0) {}
+
+/**
+ * Destructor
+ */
+Snapshot::~Snapshot() {
+	if ( base != NULL ) {
+		munmap(base, length);
+	}
+}
+
+/**
+ * FUNCTION NAME: open
+ *
+ * DESCRIPTION: Maps the file read-only and checks its header. Pages are only read
+ * 				from disk when a lookup or the rebuild touches them.
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int Snapshot::open() {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if ( fd < 0 ) {
+		return FAILURE;
+	}
+	off_t fileSize = lseek(fd, 0, SEEK_END);
+	if ( fileSize < SNAPSHOT_PAGE ) {
+		close(fd);
+		return FAILURE;
+	}
+	void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping keeps the file referenced
+	close(fd);
+	if ( mapping == MAP_FAILED ) {
+		return FAILURE;
+	}
+	base = (char *)mapping;
+	length = fileSize;
+
+	uint64_t indexOffset = getU64(base + 16);
+	entries = getU64(base + 8);
+	uint32_t version = getU32(base + 4);
+	if ( getU32(base) != SNAPSHOT_MAGIC || (version != 1 && version != SNAPSHOT_VERSION) || getU64(base + 24) != length
+			|| indexOffset < SNAPSHOT_PAGE || indexOffset > length || (length - indexOffset) / 8 < entries ) {
+		return FAILURE;
+	}
+	index = base + indexOffset;
+	// the index is hit by every lookup, so fault it in now
+	madvise(base + indexOffset, length - indexOffset, MADV_WILLNEED);
+
+	newest = getU64(base + 32);
+	if ( version == 1 ) {
+		// written before the header kept it: found once, the slow way
+		string_view key, value;
+		for ( uint64_t i = 0; i < entries; i++ ) {
+			if ( entry(i, &key, &value) ) {
+				newest = max(newest, Record::timestampOf(value));
+			}
+		}
+	}
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: entry
+ *
+ * DESCRIPTION: Points key and value at the i-th entry, in key order, inside the mapping
+ */
+bool Snapshot::entry(uint64_t i, string_view *key, string_view *value) {
+	if ( i >= entries ) {
+		return false;
+	}
+	uint64_t offset = getU64(index + i * 8);
+	if ( offset < SNAPSHOT_PAGE || offset + ENTRY_HEADER > length ) {
+		return false;
+	}
+	uint32_t keySize = getU32(base + offset);
+	uint32_t valueSize = getU32(base + offset + 4);
+	if ( offset + ENTRY_HEADER + keySize + valueSize > length ) {
+		return false;
+	}
+	*key = string_view(base + offset + ENTRY_HEADER, keySize);
+	*value = string_view(base + offset + ENTRY_HEADER + keySize, valueSize);
+	return true;
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Binary search of the key through the index
+ *
+ * RETURNS:
+ * true with *value set if the key is in the snapshot
+ */
+bool Snapshot::get(string_view key, string *value) {
+	uint64_t low = 0, high = entries;
+	string_view entryKey, entryValue;
+	while ( low < high ) {
+		uint64_t mid = low + (high - low) / 2;
+		if ( !entry(mid, &entryKey, &entryValue) ) {
+			return false;
+		}
+		if ( entryKey == key ) {
+			if ( value ) {
+				value->assign(entryValue.data(), entryValue.size());
+			}
+			return true;
+		}
+		if ( entryKey < key ) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return false;
+}
+
+uint64_t Snapshot::size() {
+	return entries;
+}
+
+/**
+ * FUNCTION NAME: newestTimestamp
+ *
+ * DESCRIPTION: Returns the newest timestamp of the records in the snapshot, so that a
+ * 				restarted node's clock can move past them without reading the entries
+ */
+uint64_t Snapshot::newestTimestamp() {
+	return newest;
+}
+
+/**
+ * FUNCTION NAME: write
+ *
+ * DESCRIPTION: Writes every pair of ht to a new snapshot at path, as of one read view
+ * 				of ht, so writes made meanwhile are not partially included.
+ * 				The data section is written in scan order; the written file is then
+ * 				mapped to sort the index by key. The file is built under a temporary
+ * 				name, synced and renamed into place, so a crash leaves the old snapshot.
+ * 				The values are records: the newest of their timestamps goes in the header.
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int Snapshot::write(string path, HashTable *ht) {
+	string tmpPath = path + ".tmp";
+	int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if ( fd < 0 ) {
+		return FAILURE;
+	}
+
+	vector<uint64_t> offsets;
+	offsets.reserve(ht->currentSize());
+	string buffer;
+	uint64_t bufferStart = SNAPSHOT_PAGE;
+	bool ok = true;
+	uint64_t newest = 0;
+	uint64_t view = ht->openView();
+	ht->scanAt(view, [&](string_view key, string_view value) {
+		newest = max(newest, Record::timestampOf(value));
+		offsets.push_back(bufferStart + buffer.size());
+		putU32(buffer, (uint32_t)key.size());
+		putU32(buffer, (uint32_t)value.size());
+		buffer.append(key.data(), key.size());
+		buffer.append(value.data(), value.size());
+		if ( buffer.size() >= SNAPSHOT_WRITE_CHUNK ) {
+			ok = ok && writeAll(fd, buffer, bufferStart);
+			bufferStart += buffer.size();
+			buffer.clear();
+		}
+	});
+	ht->closeView(view);
+	ok = ok && writeAll(fd, buffer, bufferStart);
+	uint64_t indexOffset = pageAlign(bufferStart + buffer.size());
+	uint64_t fileSize = indexOffset + offsets.size() * 8;
+
+	if ( ok && !offsets.empty() ) {
+		// order the index by key, reading the keys back through a mapping of the data
+		char *data = (char *)mmap(NULL, indexOffset, PROT_READ, MAP_SHARED, fd, 0);
+		if ( data == MAP_FAILED ) {
+			ok = false;
+		}
+		else {
+			auto keyAt = [data](uint64_t offset) {
+				return string_view(data + offset + ENTRY_HEADER, getU32(data + offset));
+			};
+			sort(offsets.begin(), offsets.end(), [&](uint64_t a, uint64_t b) {
+				return keyAt(a) < keyAt(b);
+			});
+			munmap(data, indexOffset);
+		}
+	}
+
+	string bytes;
+	bytes.reserve(offsets.size() * 8);
+	for ( unsigned int i = 0; i < offsets.size(); i++ ) {
+		putU64(bytes, offsets[i]);
+	}
+	ok = ok && writeAll(fd, bytes, indexOffset);
+
+	string header;
+	putU32(header, SNAPSHOT_MAGIC);
+	putU32(header, SNAPSHOT_VERSION);
+	putU64(header, offsets.size());
+	putU64(header, indexOffset);
+	putU64(header, fileSize);
+	putU64(header, newest);
+	ok = ok && writeAll(fd, header, 0) && ftruncate(fd, fileSize) == 0 && fsync(fd) == 0;
+	close(fd);
+
+	if ( !ok || rename(tmpPath.c_str(), path.c_str()) != 0 ) {
+		unlink(tmpPath.c_str());
+		return FAILURE;
+	}
+	return SUCCESS;
+}
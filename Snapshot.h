@@ -0,0 +1,60 @@
+/**********************************
+ * FILE NAME: Snapshot.h
+ *
+ * DESCRIPTION: Header file of the memory-mapped snapshot of a node's key space
+ **********************************/
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "HashTable.h"
+#include <stdint.h>
+#include <string_view>
+
+/*
+ * Macros
+ */
+#define SNAPSHOT_MAGIC 0x50414e53
+#define SNAPSHOT_VERSION 2
+// every section of the file starts on a page boundary
+#define SNAPSHOT_PAGE 4096
+// size of the buffered writes done while taking a snapshot
+#define SNAPSHOT_WRITE_CHUNK (1 << 20)
+
+/**
+ * CLASS NAME: Snapshot
+ *
+ * DESCRIPTION: Read-only view of a snapshot file, mapped with mmap so that it can
+ * 				serve reads as soon as it is opened; nothing is parsed up front.
+ * 				Layout, each section page-aligned:
+ * 				header [u32 magic][u32 version][u64 entries][u64 index offset][u64 file size]
+ * 				[u64 newest record timestamp],
+ * 				data ([u32 key length][u32 value length][key][value])*,
+ * 				index (u64 offset of each entry, in key order).
+ */
+class Snapshot {
+private:
+	string path;
+	char *base;
+	size_t length;
+	uint64_t entries;
+	const char *index;
+	uint64_t newest;
+public:
+	Snapshot(string path);
+	int open();
+	bool get(string_view key, string *value);
+	// i-th entry in key order; false if the entry is corrupt
+	bool entry(uint64_t i, string_view *key, string_view *value);
+	uint64_t size();
+	// newest timestamp of the records stored, read from the header
+	uint64_t newestTimestamp();
+	static int write(string path, HashTable *ht);
+	virtual ~Snapshot();
+};
+
+#endif /* SNAPSHOT_H_ */
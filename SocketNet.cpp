@@ -0,0 +1,519 @@
+/**********************************
+ * FILE NAME: SocketNet.cpp
+ *
+ * DESCRIPTION: Definition of the transport over loopback sockets
+ **********************************/
+
+#include "SocketNet.h"
+#include "Coding.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/**
+ * FUNCTION NAME: loopback
+ *
+ * DESCRIPTION: Returns the address of a port of 127.0.0.1
+ */
+struct sockaddr_in SocketNet::loopback(unsigned short port) {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	return addr;
+}
+
+/**
+ * Constructor
+ *
+ * DESCRIPTION: type is SOCK_DGRAM or SOCK_STREAM; node id i uses port basePort + i
+ */
+SocketNet::SocketNet(Params *p, int type, unsigned short basePort): par(p), type(type), basePort(basePort), nextid(1) {
+	endpoints.assign(SOCKET_MAX_NODES + 1, NULL);
+}
+
+/**
+ * Destructor
+ */
+SocketNet::~SocketNet() {
+	ENcleanup();
+}
+
+/**
+ * FUNCTION NAME: ENinit
+ *
+ * DESCRIPTION: Gives the node the next id, and binds its socket right away so that it
+ * 				can be reached as soon as its address is known
+ */
+void *SocketNet::ENinit(Address *myaddr, short port) {
+	*(int *)(myaddr->addr) = nextid++;
+	*(short *)(&myaddr->addr[4]) = 0;
+	endpointOf(*(int *)(myaddr->addr));
+	return myaddr;
+}
+
+/**
+ * FUNCTION NAME: ENmaxPayload
+ *
+ * DESCRIPTION: Returns the size of the largest message ENsend accepts
+ */
+int SocketNet::ENmaxPayload() {
+	return par->MAX_MSG_SIZE - 1;
+}
+
+/**
+ * FUNCTION NAME: endpointOf
+ *
+ * DESCRIPTION: Returns the sockets of node id, creating them on first use: nodes that
+ * 				got their address from another network are bound when they first send
+ * 				or poll
+ */
+SocketNet::Endpoint *SocketNet::endpointOf(int id) {
+	assert(id > 0 && id <= SOCKET_MAX_NODES);
+	if ( endpoints[id] ) {
+		return endpoints[id];
+	}
+
+	Endpoint *endpoint = new Endpoint();
+	endpoint->id = id;
+	endpoint->socket = NULL;
+	endpoint->sent = endpoint->received = endpoint->dropped = 0;
+	endpoint->epollFd = -1;
+	endpoints[id] = endpoint;
+
+	int fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int on = 1;
+	struct sockaddr_in addr = loopback(basePort + id);
+	if ( fd < 0 ) {
+		fprintf(stderr, "SocketNet: no socket for node %d: %s\n", id, strerror(errno));
+		return endpoint;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if ( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || (type == SOCK_STREAM && listen(fd, SOMAXCONN) < 0) ) {
+		fprintf(stderr, "SocketNet: cannot bind node %d to port %d: %s\n", id, basePort + id, strerror(errno));
+		::close(fd);
+		return endpoint;
+	}
+	endpoint->socket = newConnection(endpoint, type == SOCK_STREAM ? LISTENER : DATAGRAM, fd, EPOLLIN);
+	return endpoint;
+}
+
+/**
+ * FUNCTION NAME: newConnection
+ *
+ * DESCRIPTION: Wraps fd and adds it to the epoll set of the endpoint
+ */
+SocketNet::Connection *SocketNet::newConnection(Endpoint *endpoint, SocketKind kind, int fd, uint32_t events) {
+	Connection *connection = new Connection();
+	connection->kind = kind;
+	connection->fd = fd;
+	connection->peer = 0;
+	connection->events = events;
+
+	if ( endpoint->epollFd < 0 ) {
+		endpoint->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	}
+	struct epoll_event event;
+	event.events = events;
+	event.data.ptr = connection;
+	epoll_ctl(endpoint->epollFd, EPOLL_CTL_ADD, fd, &event);
+	return connection;
+}
+
+/**
+ * FUNCTION NAME: watch
+ *
+ * DESCRIPTION: Sets the epoll events of the connection, if they changed
+ */
+void SocketNet::watch(Endpoint *endpoint, Connection *connection, uint32_t events) {
+	if ( connection->events == events ) {
+		return;
+	}
+	struct epoll_event event;
+	event.events = events;
+	event.data.ptr = connection;
+	epoll_ctl(endpoint->epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+	connection->events = events;
+}
+
+/**
+ * FUNCTION NAME: detach
+ *
+ * DESCRIPTION: Forgets a TCP connection of the endpoint; closeConnection counts the messages
+ * 				it had not written as dropped
+ */
+void SocketNet::detach(Endpoint *endpoint, Connection *connection) {
+	if ( connection->kind == OUTBOUND ) {
+		endpoint->outbound.erase(connection->peer);
+	}
+	else {
+		endpoint->inbound.erase(connection->fd);
+	}
+}
+
+/**
+ * FUNCTION NAME: closeConnection
+ *
+ * DESCRIPTION: Closes a TCP connection; the messages it had not written are lost
+ */
+void SocketNet::closeConnection(Endpoint *endpoint, Connection *connection) {
+	endpoint->dropped += connection->unsent.size();
+	detach(endpoint, connection);
+	// closing the descriptor also takes it out of the epoll set
+	::close(connection->fd);
+	delete connection;
+}
+
+/**
+ * FUNCTION NAME: connectTo
+ *
+ * DESCRIPTION: Returns the TCP connection of the endpoint to node id, opening it if needed.
+ * 				The connect completes in the background; writes wait for it in the buffer.
+ *
+ * RETURNS:
+ * the connection
+ * NULL if it could not be opened
+ */
+SocketNet::Connection *SocketNet::connectTo(Endpoint *endpoint, int id) {
+	auto found = endpoint->outbound.find(id);
+	if ( found != endpoint->outbound.end() ) {
+		return found->second;
+	}
+
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	int on = 1;
+	struct sockaddr_in addr = loopback(basePort + id);
+	if ( fd < 0 ) {
+		return NULL;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	if ( connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS ) {
+		::close(fd);
+		return NULL;
+	}
+	// EPOLLIN only reports the peer closing: nothing is ever sent back
+	Connection *connection = newConnection(endpoint, OUTBOUND, fd, EPOLLIN);
+	connection->peer = id;
+	endpoint->outbound[id] = connection;
+	return connection;
+}
+
+/**
+ * FUNCTION NAME: flush
+ *
+ * DESCRIPTION: Writes as much of the buffer of an outbound connection as the kernel takes,
+ * 				then watches for room for the rest. Closes the connection on an error.
+ */
+void SocketNet::flush(Endpoint *endpoint, Connection *connection) {
+	size_t written = 0;
+	while ( written < connection->buffer.size() ) {
+		ssize_t n = send(connection->fd, connection->buffer.data() + written, connection->buffer.size() - written, MSG_NOSIGNAL);
+		if ( n > 0 ) {
+			written += n;
+			continue;
+		}
+		if ( n < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOTCONN ) {
+			countWritten(endpoint, connection, written);
+			closeConnection(endpoint, connection);
+			return;
+		}
+		break;
+	}
+	countWritten(endpoint, connection, written);
+	connection->buffer.erase(0, written);
+	watch(endpoint, connection, connection->buffer.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+}
+
+/**
+ * FUNCTION NAME: countWritten
+ *
+ * DESCRIPTION: Counts as sent the frames of an outbound connection that the bytes just
+ * 				written complete
+ */
+void SocketNet::countWritten(Endpoint *endpoint, Connection *connection, size_t bytes) {
+	while ( bytes > 0 && !connection->unsent.empty() ) {
+		size_t &left = connection->unsent.front();
+		if ( bytes < left ) {
+			left -= bytes;
+			return;
+		}
+		bytes -= left;
+		connection->unsent.pop_front();
+		endpoint->sent++;
+	}
+}
+
+/**
+ * FUNCTION NAME: lost
+ *
+ * DESCRIPTION: Returns true if a message of size bytes is not to be sent: too large, or
+ * 				dropped with MSG_DROP_PROB as in EmulNet
+ */
+bool SocketNet::lost(int size) {
+	int sendmsg = rand() % 100;
+	return size > ENmaxPayload() || (par->dropmsg && sendmsg < (int) (par->MSG_DROP_PROB * 100));
+}
+
+/**
+ * FUNCTION NAME: ENsend
+ *
+ * DESCRIPTION: Sends a message: one datagram, or one frame on the connection to the node.
+ * 				A frame is written straight from data when nothing is waiting before it,
+ * 				otherwise it is queued behind, up to SOCKET_MAX_PENDING bytes; it counts as
+ * 				sent once wholly written.
+ * 				Writes pass MSG_NOSIGNAL: a peer gone must not raise SIGPIPE.
+ * 				MSG_DROP_PROB drops messages as in EmulNet.
+ *
+ * RETURNS:
+ * size, 0 if the message was dropped
+ */
+int SocketNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
+	if ( lost(size) ) {
+		return 0;
+	}
+
+	Endpoint *endpoint = endpointOf(*(int *)(myaddr->addr));
+	int dst = *(int *)(toaddr->addr);
+	assert(dst > 0 && dst <= SOCKET_MAX_NODES);
+
+	if ( type == SOCK_DGRAM ) {
+		struct sockaddr_in addr = loopback(basePort + dst);
+		if ( endpoint->socket == NULL || sendto(endpoint->socket->fd, data, size, 0, (struct sockaddr *)&addr, sizeof(addr)) != size ) {
+			endpoint->dropped++;
+			return 0;
+		}
+		endpoint->sent++;
+		return size;
+	}
+
+	Connection *connection = connectTo(endpoint, dst);
+	if ( connection == NULL || connection->buffer.size() + SOCKET_FRAME_HEADER + size > SOCKET_MAX_PENDING ) {
+		endpoint->dropped++;
+		return 0;
+	}
+	char header[SOCKET_FRAME_HEADER];
+	encodeU32(header, (uint32_t)size);
+	size_t written = 0;
+	if ( connection->buffer.empty() ) {
+		struct iovec parts[2] = { { header, SOCKET_FRAME_HEADER }, { data, (size_t)size } };
+		struct msghdr message;
+		memset(&message, 0, sizeof(message));
+		message.msg_iov = parts;
+		message.msg_iovlen = 2;
+		ssize_t n = sendmsg(connection->fd, &message, MSG_NOSIGNAL);
+		written = n > 0 ? n : 0;
+	}
+	if ( written == SOCKET_FRAME_HEADER + (size_t)size ) {
+		endpoint->sent++;
+		return size;
+	}
+	connection->unsent.push_back(SOCKET_FRAME_HEADER + size - written);
+	if ( written < SOCKET_FRAME_HEADER ) {
+		connection->buffer.append(header + written, SOCKET_FRAME_HEADER - written);
+		written = 0;
+	}
+	else {
+		written -= SOCKET_FRAME_HEADER;
+	}
+	connection->buffer.append(data + written, size - written);
+	flush(endpoint, connection);
+	return size;
+}
+
+/**
+ * FUNCTION NAME: deliver
+ *
+ * DESCRIPTION: Hands a copy of a received message to the node's queue
+ */
+void SocketNet::deliver(Endpoint *endpoint, const char *data, int size, int (* enq)(void *, char *, int), void *queue) {
+	char *copy = (char *) malloc(size);
+	memcpy(copy, data, size);
+	(*enq)(queue, copy, size);
+	endpoint->received++;
+}
+
+/**
+ * FUNCTION NAME: readDatagrams
+ *
+ * DESCRIPTION: Delivers every datagram waiting on the UDP socket
+ */
+void SocketNet::readDatagrams(Endpoint *endpoint, int (* enq)(void *, char *, int), void *queue) {
+	char buffer[65536];
+	for ( ;; ) {
+		ssize_t n = recv(endpoint->socket->fd, buffer, sizeof(buffer), 0);
+		if ( n < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( n < 0 ) {
+			return;
+		}
+		deliver(endpoint, buffer, (int)n, enq, queue);
+	}
+}
+
+/**
+ * FUNCTION NAME: readStream
+ *
+ * DESCRIPTION: Reads what arrived on an accepted connection and delivers each whole frame.
+ * 				Closes the connection at its end, or if a frame is larger than any
+ * 				message could be.
+ */
+void SocketNet::readStream(Endpoint *endpoint, Connection *connection, int (* enq)(void *, char *, int), void *queue) {
+	char buffer[65536];
+	bool open = true;
+	for ( ;; ) {
+		ssize_t n = recv(connection->fd, buffer, sizeof(buffer), 0);
+		if ( n < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( n <= 0 ) {
+			open = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+			break;
+		}
+		connection->buffer.append(buffer, n);
+	}
+
+	if ( !deliverFrames(endpoint, connection, enq, queue) || !open ) {
+		closeConnection(endpoint, connection);
+	}
+}
+
+/**
+ * FUNCTION NAME: deliverFrames
+ *
+ * DESCRIPTION: Delivers each whole frame at the start of the buffer of an accepted connection
+ * 				and keeps the incomplete rest
+ *
+ * RETURNS:
+ * false if a frame is larger than any message could be, true otherwise
+ */
+bool SocketNet::deliverFrames(Endpoint *endpoint, Connection *connection, int (* enq)(void *, char *, int), void *queue) {
+	size_t pos = 0;
+	bool valid = true;
+	string &input = connection->buffer;
+	while ( input.size() - pos >= SOCKET_FRAME_HEADER ) {
+		uint32_t size = getU32(input.data() + pos);
+		if ( size > (uint32_t)ENmaxPayload() ) {
+			valid = false;
+			break;
+		}
+		if ( input.size() - pos - SOCKET_FRAME_HEADER < size ) {
+			break;
+		}
+		deliver(endpoint, input.data() + pos + SOCKET_FRAME_HEADER, (int)size, enq, queue);
+		pos += SOCKET_FRAME_HEADER + size;
+	}
+	input.erase(0, pos);
+	return valid;
+}
+
+/**
+ * FUNCTION NAME: acceptConnections
+ *
+ * DESCRIPTION: Accepts every connection waiting on the TCP listener
+ */
+void SocketNet::acceptConnections(Endpoint *endpoint) {
+	for ( ;; ) {
+		int fd = accept4(endpoint->socket->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if ( fd < 0 && errno == EINTR ) {
+			continue;
+		}
+		if ( fd < 0 ) {
+			return;
+		}
+		endpoint->inbound[fd] = newConnection(endpoint, INBOUND, fd, EPOLLIN);
+	}
+}
+
+/**
+ * FUNCTION NAME: ENrecv
+ *
+ * DESCRIPTION: Runs the event loop of the node once, without waiting: delivers the messages
+ * 				that arrived, accepts connections and writes what was left unsent
+ *
+ * RETURN:
+ * 0
+ */
+int SocketNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) {
+	Endpoint *endpoint = endpointOf(*(int *)(myaddr->addr));
+	struct epoll_event events[SOCKET_EVENTS];
+	int count;
+
+	if ( endpoint->epollFd < 0 ) {
+		return 0;
+	}
+	do {
+		count = epoll_wait(endpoint->epollFd, events, SOCKET_EVENTS, 0);
+		for ( int i = 0; i < count; i++ ) {
+			Connection *connection = (Connection *)events[i].data.ptr;
+			if ( connection->kind == DATAGRAM ) {
+				readDatagrams(endpoint, enq, queue);
+			}
+			else if ( connection->kind == LISTENER ) {
+				acceptConnections(endpoint);
+			}
+			else if ( connection->kind == INBOUND ) {
+				readStream(endpoint, connection, enq, queue);
+			}
+			else if ( events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP) ) {
+				// the receiver closed or reset its end
+				closeConnection(endpoint, connection);
+			}
+			else {
+				flush(endpoint, connection);
+			}
+		}
+	} while ( count == SOCKET_EVENTS );
+
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: ENcleanup
+ *
+ * DESCRIPTION: Closes every socket and writes the message counts of the nodes to
+ * 				msgcount.log. Called once at the end of the program.
+ */
+int SocketNet::ENcleanup() {
+	FILE *file = NULL;
+	for ( int id = 1; id <= SOCKET_MAX_NODES; id++ ) {
+		Endpoint *endpoint = endpoints[id];
+		if ( endpoint == NULL ) {
+			continue;
+		}
+		if ( file == NULL ) {
+			file = fopen("msgcount.log", "w+");
+		}
+		fprintf(file, "node %3d sent_total %6lu  recv_total %6lu", id, endpoint->sent, endpoint->received);
+		if ( endpoint->dropped > 0 ) {
+			fprintf(file, "  dropped_total %6lu", endpoint->dropped);
+		}
+		fprintf(file, "\n");
+
+		while ( !endpoint->inbound.empty() ) {
+			closeConnection(endpoint, endpoint->inbound.begin()->second);
+		}
+		while ( !endpoint->outbound.empty() ) {
+			closeConnection(endpoint, endpoint->outbound.begin()->second);
+		}
+		if ( endpoint->socket ) {
+			::close(endpoint->socket->fd);
+			delete endpoint->socket;
+		}
+		if ( endpoint->epollFd >= 0 ) {
+			::close(endpoint->epollFd);
+		}
+		delete endpoint;
+		endpoints[id] = NULL;
+	}
+	if ( file ) {
+		fclose(file);
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+/**********************************
+ * FILE NAME: SocketNet.h
+ *
+ * DESCRIPTION: Header file of the transport over loopback sockets
+ **********************************/
+
+#ifndef _SOCKETNET_H_
+#define _SOCKETNET_H_
+
+#include "stdincludes.h"
+#include "Params.h"
+#include "Member.h"
+#include "Network.h"
+#include <stdint.h>
+#include <deque>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// node ids map to ports base + id, so as many ports per network are taken from the base
+#define SOCKET_MAX_NODES 1000
+// events read by one epoll_wait
+#define SOCKET_EVENTS 64
+// bytes a TCP connection may hold unsent before further messages to its node are dropped
+#define SOCKET_MAX_PENDING (1 << 20)
+// [u32 size] before every message on a TCP connection
+#define SOCKET_FRAME_HEADER 4
+
+/**
+ * CLASS NAME: SocketNet
+ *
+ * DESCRIPTION: Network whose nodes talk over real sockets bound to 127.0.0.1, so that the
+ * 				system calls and copies of a real transport are paid; the nodes may run in
+ * 				one process, as the Application does, or each in its own.
+ * 				Node id i listens on port base + i: with SOCK_DGRAM each message is one UDP
+ * 				datagram; with SOCK_STREAM the messages are framed as [u32 size][message] on
+ * 				a TCP connection per (sender, receiver), opened by the first message.
+ * 				Addresses are the same as with EmulNet: the id then a zero port.
+ * 				Every node has its own non-blocking sockets and epoll set, which ENrecv
+ * 				polls without waiting: it accepts connections, reads what arrived, and
+ * 				finishes writes the kernel could not take at once. A message that cannot
+ * 				be sent is dropped, like on an unreliable network.
+ */
+class SocketNet : public Network {
+protected:
+	enum SocketKind { DATAGRAM, LISTENER, INBOUND, OUTBOUND };
+	class Connection {
+	public:
+		virtual ~Connection() {}
+		SocketKind kind;
+		int fd;
+		// id of the node at the other end of an OUTBOUND connection
+		int peer;
+		// epoll events watched
+		uint32_t events;
+		// bytes received but not yet a whole message (INBOUND), or not yet written (OUTBOUND)
+		string buffer;
+		// bytes left to write of each frame not wholly written yet (OUTBOUND), oldest first:
+		// a frame counts as sent once written, as dropped if the connection closes before
+		deque<size_t> unsent;
+	};
+	class Endpoint {
+	public:
+		int id;
+		// created with the first socket watched, -1 until then
+		int epollFd;
+		// the UDP socket or the TCP listener of the node, NULL if it could not be bound
+		Connection *socket;
+		// connections accepted, by file descriptor, and opened, by node id
+		map<int, Connection *> inbound;
+		map<int, Connection *> outbound;
+		unsigned long sent;
+		unsigned long received;
+		unsigned long dropped;
+	};
+	Params *par;
+	int type;
+	unsigned short basePort;
+	int nextid;
+	vector<Endpoint *> endpoints;
+	static struct sockaddr_in loopback(unsigned short port);
+	Endpoint *endpointOf(int id);
+	Connection *connectTo(Endpoint *endpoint, int id);
+	virtual Connection *newConnection(Endpoint *endpoint, SocketKind kind, int fd, uint32_t events);
+	void watch(Endpoint *endpoint, Connection *connection, uint32_t events);
+	void detach(Endpoint *endpoint, Connection *connection);
+	virtual void closeConnection(Endpoint *endpoint, Connection *connection);
+	void flush(Endpoint *endpoint, Connection *connection);
+	bool lost(int size);
+	void countWritten(Endpoint *endpoint, Connection *connection, size_t bytes);
+	void readDatagrams(Endpoint *endpoint, int (* enq)(void *, char *, int), void *queue);
+	void readStream(Endpoint *endpoint, Connection *connection, int (* enq)(void *, char *, int), void *queue);
+	bool deliverFrames(Endpoint *endpoint, Connection *connection, int (* enq)(void *, char *, int), void *queue);
+	void acceptConnections(Endpoint *endpoint);
+	void deliver(Endpoint *endpoint, const char *data, int size, int (* enq)(void *, char *, int), void *queue);
+public:
+	SocketNet(Params *p, int type, unsigned short basePort);
+	virtual ~SocketNet();
+	void *ENinit(Address *myaddr, short port);
+	int ENsend(Address *myaddr, Address *toaddr, char *data, int size);
+	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	int ENcleanup();
+	int ENmaxPayload();
+};
+
+#endif /* _SOCKETNET_H_ */
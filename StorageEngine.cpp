@@ -0,0 +1,156 @@
+/**********************************
+ * FILE NAME: StorageEngine.cpp
+ *
+ * DESCRIPTION: Definition of the ordered (std::map) storage engine
+ **********************************/
+
+#include "StorageEngine.h"
+
+/**
+ * FUNCTION NAME: tokenOf
+ *
+ * DESCRIPTION: Hashes the key onto the ring, the same way nodes are placed on it
+ */
+size_t StorageEngine::tokenOf(string_view key) {
+	std::hash<string_view> hashFunc;
+	return hashFunc(key) % RING_SIZE;
+}
+
+/**
+ * FUNCTION NAME: scanRange
+ *
+ * DESCRIPTION: Fallback for engines not ordered by token: filters a full scan
+ */
+void StorageEngine::scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit) {
+	scan([&](string_view key, string_view value) {
+		size_t token = tokenOf(key);
+		if ( token >= first && token < last ) {
+			visit(key, value);
+		}
+	});
+}
+
+/**
+ * Constructor
+ */
+MapEngine::MapEngine() {
+	newTable();
+}
+
+/**
+ * FUNCTION NAME: newTable
+ *
+ * DESCRIPTION: Places an empty map in the arena
+ */
+void MapEngine::newTable() {
+	table = new (arena.allocate(sizeof(Table))) Table(ArenaAllocator<pair<const string_view, Cell> >(&arena));
+}
+
+/**
+ * FUNCTION NAME: copyIn
+ *
+ * DESCRIPTION: Copies bytes into a chunk of the arena
+ */
+char *MapEngine::copyIn(string_view bytes) {
+	char *chunk = arena.allocate(bytes.size());
+	memcpy(chunk, bytes.data(), bytes.size());
+	return chunk;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Looks the key up and copies its value out
+ *
+ * RETURNS:
+ * true if found
+ * false otherwise
+ */
+bool MapEngine::find(string_view key, string *value) {
+	Table::iterator search = table->find(key);
+	if ( search == table->end() ) {
+		return false;
+	}
+	if ( value ) {
+		value->assign(search->second.value, search->second.size);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: mutate
+ *
+ * DESCRIPTION: Finds the position of the key with one descent of the tree and
+ * 				inserts, overwrites or erases there as decide asks
+ */
+void MapEngine::mutate(string_view key, const Mutator &decide) {
+	Table::iterator hint = table->lower_bound(key);
+	bool found = hint != table->end() && hint->first == key;
+	string_view current, replacement;
+
+	if ( found ) {
+		current = string_view(hint->second.value, hint->second.size);
+	}
+	MutateAction action = decide(found ? &current : NULL, &replacement);
+
+	if ( action == STORE_VALUE ) {
+		if ( found ) {
+			Cell &cell = hint->second;
+			cell.value = arena.reallocate(cell.value, cell.size, replacement.size());
+			cell.size = (uint32_t)replacement.size();
+			memcpy(cell.value, replacement.data(), replacement.size());
+		}
+		else {
+			Cell cell;
+			cell.value = copyIn(replacement);
+			cell.size = (uint32_t)replacement.size();
+			table->emplace_hint(hint, string_view(copyIn(key), key.size()), cell);
+		}
+	}
+	else if ( action == ERASE_VALUE && found ) {
+		char *keyBytes = (char *)hint->first.data();
+		size_t keySize = hint->first.size();
+		arena.deallocate(hint->second.value, hint->second.size);
+		table->erase(hint);
+		arena.deallocate(keyBytes, keySize);
+	}
+}
+
+/**
+ * FUNCTION NAME: size
+ *
+ * DESCRIPTION: Returns the number of stored pairs
+ */
+unsigned long MapEngine::size() {
+	return (unsigned long)table->size();
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Removes all pairs by resetting the arena; the tree is never walked
+ */
+void MapEngine::clear() {
+	arena.reset();
+	newTable();
+}
+
+/**
+ * FUNCTION NAME: scan
+ *
+ * DESCRIPTION: Visits every pair in key order
+ */
+void MapEngine::scan(const function<void(string_view, string_view)> &visit) {
+	for ( Table::iterator it = table->begin(); it != table->end(); it++ ) {
+		visit(it->first, string_view(it->second.value, it->second.size));
+	}
+}
+
+/**
+ * FUNCTION NAME: getStats
+ *
+ * DESCRIPTION: Returns the arena usage of this engine
+ */
+ArenaStats MapEngine::getStats() {
+	return arena.getStats();
+}
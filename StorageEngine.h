@@ -0,0 +1,107 @@
+/**********************************
+ * FILE NAME: StorageEngine.h
+ *
+ * DESCRIPTION: Header file of the storage engines behind HashTable
+ **********************************/
+
+#ifndef STORAGEENGINE_H_
+#define STORAGEENGINE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "SlabArena.h"
+#include <functional>
+#include <string_view>
+#include <type_traits>
+
+// what a Mutator asks the engine to do with the probed key
+enum MutateAction { KEEP_VALUE, STORE_VALUE, ERASE_VALUE };
+
+/**
+ * CLASS NAME: Mutator
+ *
+ * DESCRIPTION: Refers to the callable deciding a mutation, called once with the current
+ * 				value of the key (NULL if absent). For STORE_VALUE it sets *replacement,
+ * 				which must not point into *current.
+ * 				The callable is not copied, so a write allocates nothing for its lambda;
+ * 				the Mutator must not be kept past the mutate call it is passed to.
+ */
+class Mutator {
+private:
+	void *callable;
+	MutateAction (*invoke)(void *callable, const string_view *current, string_view *replacement);
+public:
+	template <class F, class = typename enable_if<!is_same<typename decay<F>::type, Mutator>::value>::type>
+	Mutator(F &&decide): callable((void *)&decide) {
+		invoke = [](void *callable, const string_view *current, string_view *replacement) {
+			return (*(typename remove_reference<F>::type *)callable)(current, replacement);
+		};
+	}
+	MutateAction operator ()(const string_view *current, string_view *replacement) const {
+		return invoke(callable, current, replacement);
+	}
+};
+
+/**
+ * CLASS NAME: StorageEngine
+ *
+ * DESCRIPTION: Interface implemented by every key/value backend of HashTable.
+ * 				Each operation must resolve the key with a single lookup.
+ */
+class StorageEngine {
+public:
+	virtual ~StorageEngine() {}
+	// copy the value of key into *value (if not NULL); false if the key is absent
+	virtual bool find(string_view key, string *value) = 0;
+	// false only if the key is certainly absent; must not do any I/O
+	virtual bool mayContain(string_view key) { return true; }
+	// probe the key once and apply what decide asks for
+	virtual void mutate(string_view key, const Mutator &decide) = 0;
+	virtual unsigned long size() = 0;
+	virtual void clear() = 0;
+	// visit every pair, in key order if the backend is ordered
+	virtual void scan(const function<void(string_view, string_view)> &visit) = 0;
+	// visit the pairs whose ring token is in [first, last); scans everything unless overridden
+	virtual void scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit);
+	// position of a key on the ring, in [0, RING_SIZE)
+	static size_t tokenOf(string_view key);
+	// make the mutations so far durable, for backends keeping files; SUCCESS or FAILURE
+	virtual int sync() { return SUCCESS; }
+	// run beforeWrite before mutations are written to files; its FAILURE postpones the write
+	virtual void setFlushHook(const function<int()> &beforeWrite) {}
+	// memory held for keys and values
+	virtual ArenaStats getStats() = 0;
+};
+
+/**
+ * CLASS NAME: MapEngine
+ *
+ * DESCRIPTION: Ordered backend wrapping the map provided by C++ STL.
+ * 				Map nodes, keys and values are all allocated from the engine's arena.
+ */
+class MapEngine : public StorageEngine {
+private:
+	class Cell {
+	public:
+		char *value;
+		uint32_t size;
+	};
+	typedef map<string_view, Cell, less<string_view>, ArenaAllocator<pair<const string_view, Cell> > > Table;
+	SlabArena arena;
+	// lives in the arena too, so clear() never walks the tree
+	Table *table;
+	char *copyIn(string_view bytes);
+	void newTable();
+public:
+	MapEngine();
+	bool find(string_view key, string *value);
+	void mutate(string_view key, const Mutator &decide);
+	unsigned long size();
+	void clear();
+	void scan(const function<void(string_view, string_view)> &visit);
+	ArenaStats getStats();
+};
+
+#endif /* STORAGEENGINE_H_ */
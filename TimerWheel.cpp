@@ -0,0 +1,94 @@
+/**********************************
+ * FILE NAME: TimerWheel.cpp
+ *
+ * DESCRIPTION: Definition of the hierarchical timing wheel driving key expiry
+ **********************************/
+
+#include "TimerWheel.h"
+
+/**
+ * Constructor
+ */
+TimerWheel::TimerWheel(uint32_t now): current(now), pending(0) {}
+
+/**
+ * FUNCTION NAME: place
+ *
+ * DESCRIPTION: Moves the timer into the slot of the lowest level reaching its deadline.
+ * 				A timer cascading onto the current tick goes to the slot about to fire.
+ */
+void TimerWheel::place(Timer &timer) {
+	if ( timer.deadline <= current ) {
+		slots[0][current % WHEEL_SLOTS].push_back(std::move(timer));
+		return;
+	}
+	uint32_t delta = timer.deadline - current;
+	int level = 0;
+	while ( level < WHEEL_LEVELS - 1 && delta >= (uint32_t)1 << (WHEEL_BITS * (level + 1)) ) {
+		level++;
+	}
+	slots[level][(timer.deadline >> (WHEEL_BITS * level)) % WHEEL_SLOTS].push_back(std::move(timer));
+}
+
+/**
+ * FUNCTION NAME: schedule
+ *
+ * DESCRIPTION: Calls fire for key once the wheel reaches deadline
+ */
+void TimerWheel::schedule(string_view key, uint32_t deadline) {
+	Timer timer;
+	timer.key.assign(key.data(), key.size());
+	timer.deadline = deadline;
+	pending++;
+	if ( deadline <= current ) {
+		// the current tick was already fired
+		slots[0][(current + 1) % WHEEL_SLOTS].push_back(std::move(timer));
+		return;
+	}
+	place(timer);
+}
+
+/**
+ * FUNCTION NAME: advance
+ *
+ * DESCRIPTION: Turns the wheel tick by tick up to now, firing the timers that are due.
+ * 				On the first tick of each turn of a level, the slot of the level above
+ * 				that starts is emptied into the lower levels (cascading).
+ *
+ * RETURNS:
+ * number of timers fired
+ */
+unsigned long TimerWheel::advance(uint32_t now, const function<void(const string &key, uint32_t deadline)> &fire) {
+	unsigned long fired = 0;
+
+	while ( current < now ) {
+		current++;
+		for ( int level = 1; level < WHEEL_LEVELS; level++ ) {
+			if ( (current >> (WHEEL_BITS * (level - 1))) % WHEEL_SLOTS != 0 ) {
+				break;
+			}
+			vector<Timer> cascade;
+			cascade.swap(slots[level][(current >> (WHEEL_BITS * level)) % WHEEL_SLOTS]);
+			for ( unsigned int i = 0; i < cascade.size(); i++ ) {
+				place(cascade[i]);
+			}
+		}
+		vector<Timer> due;
+		due.swap(slots[0][current % WHEEL_SLOTS]);
+		for ( unsigned int i = 0; i < due.size(); i++ ) {
+			fire(due[i].key, due[i].deadline);
+		}
+		fired += due.size();
+		pending -= due.size();
+	}
+	return fired;
+}
+
+/**
+ * FUNCTION NAME: size
+ *
+ * DESCRIPTION: Returns the number of timers not fired yet
+ */
+unsigned long TimerWheel::size() {
+	return pending;
+}
@@ -0,0 +1,55 @@
+/**********************************
+ * FILE NAME: TimerWheel.h
+ *
+ * DESCRIPTION: Header file of the hierarchical timing wheel driving key expiry
+ **********************************/
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <functional>
+#include <stdint.h>
+#include <string_view>
+
+/*
+ * Macros
+ */
+// 4 levels of 256 slots cover every 32 bit deadline
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/**
+ * CLASS NAME: TimerWheel
+ *
+ * DESCRIPTION: Hierarchical timing wheel of keys to expire. Level 0 has a slot per tick,
+ * 				each slot of level l spans 256^l ticks. A timer sits in the lowest level
+ * 				that reaches its deadline and moves one level down each time the wheel
+ * 				above turns onto its slot, so scheduling and firing cost O(1) per timer
+ * 				whatever the number of timers.
+ * 				A timer only says when to look at a key: the record decides if it expires.
+ */
+class TimerWheel {
+private:
+	class Timer {
+	public:
+		string key;
+		uint32_t deadline;
+	};
+	vector<Timer> slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	// last tick processed
+	uint32_t current;
+	unsigned long pending;
+	void place(Timer &timer);
+public:
+	TimerWheel(uint32_t now);
+	void schedule(string_view key, uint32_t deadline);
+	unsigned long advance(uint32_t now, const function<void(const string &key, uint32_t deadline)> &fire);
+	unsigned long size();
+};
+
+#endif /* TIMERWHEEL_H_ */
@@ -0,0 +1,160 @@
+/**********************************
+ * FILE NAME: TokenEngine.cpp
+ *
+ * DESCRIPTION: Definition of the token-ordered storage engine
+ **********************************/
+
+#include "TokenEngine.h"
+
+/**
+ * Constructor
+ */
+TokenEngine::TokenEngine() {
+	newTable();
+}
+
+/**
+ * FUNCTION NAME: newTable
+ *
+ * DESCRIPTION: Places an empty map in the arena
+ */
+void TokenEngine::newTable() {
+	table = new (arena.allocate(sizeof(Table))) Table(ArenaAllocator<pair<const TokenKey, Cell> >(&arena));
+}
+
+/**
+ * FUNCTION NAME: copyIn
+ *
+ * DESCRIPTION: Copies bytes into a chunk of the arena
+ */
+char *TokenEngine::copyIn(string_view bytes) {
+	char *chunk = arena.allocate(bytes.size());
+	memcpy(chunk, bytes.data(), bytes.size());
+	return chunk;
+}
+
+/**
+ * FUNCTION NAME: tokenKey
+ *
+ * DESCRIPTION: Builds the map key of a key; the token is hashed once per operation
+ */
+TokenEngine::TokenKey TokenEngine::tokenKey(string_view key) {
+	TokenKey tk;
+	tk.token = (uint32_t)tokenOf(key);
+	tk.key = key;
+	return tk;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Looks the key up and copies its value out
+ *
+ * RETURNS:
+ * true if found
+ * false otherwise
+ */
+bool TokenEngine::find(string_view key, string *value) {
+	Table::iterator search = table->find(tokenKey(key));
+	if ( search == table->end() ) {
+		return false;
+	}
+	if ( value ) {
+		value->assign(search->second.value, search->second.size);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: mutate
+ *
+ * DESCRIPTION: Finds the position of the key with one descent of the tree and
+ * 				inserts, overwrites or erases there as decide asks
+ */
+void TokenEngine::mutate(string_view key, const Mutator &decide) {
+	TokenKey tk = tokenKey(key);
+	Table::iterator hint = table->lower_bound(tk);
+	bool found = hint != table->end() && hint->first == tk;
+	string_view current, replacement;
+
+	if ( found ) {
+		current = string_view(hint->second.value, hint->second.size);
+	}
+	MutateAction action = decide(found ? &current : NULL, &replacement);
+
+	if ( action == STORE_VALUE ) {
+		if ( found ) {
+			Cell &cell = hint->second;
+			cell.value = arena.reallocate(cell.value, cell.size, replacement.size());
+			cell.size = (uint32_t)replacement.size();
+			memcpy(cell.value, replacement.data(), replacement.size());
+		}
+		else {
+			Cell cell;
+			cell.value = copyIn(replacement);
+			cell.size = (uint32_t)replacement.size();
+			tk.key = string_view(copyIn(key), key.size());
+			table->emplace_hint(hint, tk, cell);
+		}
+	}
+	else if ( action == ERASE_VALUE && found ) {
+		char *keyBytes = (char *)hint->first.key.data();
+		size_t keySize = hint->first.key.size();
+		arena.deallocate(hint->second.value, hint->second.size);
+		table->erase(hint);
+		arena.deallocate(keyBytes, keySize);
+	}
+}
+
+/**
+ * FUNCTION NAME: size
+ *
+ * DESCRIPTION: Returns the number of stored pairs
+ */
+unsigned long TokenEngine::size() {
+	return (unsigned long)table->size();
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Removes all pairs by resetting the arena; the tree is never walked
+ */
+void TokenEngine::clear() {
+	arena.reset();
+	newTable();
+}
+
+/**
+ * FUNCTION NAME: scan
+ *
+ * DESCRIPTION: Visits every pair in token order
+ */
+void TokenEngine::scan(const function<void(string_view, string_view)> &visit) {
+	for ( Table::iterator it = table->begin(); it != table->end(); it++ ) {
+		visit(it->first.key, string_view(it->second.value, it->second.size));
+	}
+}
+
+/**
+ * FUNCTION NAME: scanRange
+ *
+ * DESCRIPTION: Visits the pairs with a token in [first, last), in token order,
+ * 				starting with one descent of the tree
+ */
+void TokenEngine::scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit) {
+	TokenKey start;
+	start.token = (uint32_t)first;
+	for ( Table::iterator it = table->lower_bound(start); it != table->end() && it->first.token < last; it++ ) {
+		visit(it->first.key, string_view(it->second.value, it->second.size));
+	}
+}
+
+/**
+ * FUNCTION NAME: getStats
+ *
+ * DESCRIPTION: Returns the arena usage of this engine
+ */
+ArenaStats TokenEngine::getStats() {
+	return arena.getStats();
+}
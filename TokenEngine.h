@@ -0,0 +1,61 @@
+/**********************************
+ * FILE NAME: TokenEngine.h
+ *
+ * DESCRIPTION: Header file of the token-ordered storage engine
+ **********************************/
+
+#ifndef TOKENENGINE_H_
+#define TOKENENGINE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "StorageEngine.h"
+#include "SlabArena.h"
+#include <stdint.h>
+
+/**
+ * CLASS NAME: TokenEngine
+ *
+ * DESCRIPTION: Ordered backend sorted by ring position: pairs are kept in a map
+ * 				keyed by (token, key), so the keys of one token range are contiguous
+ * 				and scanRange walks only them. Everything lives in the engine's arena.
+ */
+class TokenEngine : public StorageEngine {
+private:
+	class TokenKey {
+	public:
+		uint32_t token;
+		string_view key;
+		bool operator <(const TokenKey &another) const {
+			return token != another.token ? token < another.token : key < another.key;
+		}
+		bool operator ==(const TokenKey &another) const {
+			return token == another.token && key == another.key;
+		}
+	};
+	class Cell {
+	public:
+		char *value;
+		uint32_t size;
+	};
+	typedef map<TokenKey, Cell, less<TokenKey>, ArenaAllocator<pair<const TokenKey, Cell> > > Table;
+	SlabArena arena;
+	// lives in the arena too, so clear() never walks the tree
+	Table *table;
+	char *copyIn(string_view bytes);
+	void newTable();
+	static TokenKey tokenKey(string_view key);
+public:
+	TokenEngine();
+	bool find(string_view key, string *value);
+	void mutate(string_view key, const Mutator &decide);
+	unsigned long size();
+	void clear();
+	void scan(const function<void(string_view, string_view)> &visit);
+	void scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit);
+	ArenaStats getStats();
+};
+
+#endif /* TOKENENGINE_H_ */
@@ -0,0 +1,611 @@
+/**********************************
+ * FILE NAME: UringNet.cpp
+ *
+ * DESCRIPTION: Definition of the transport over loopback sockets driven by io_uring
+ **********************************/
+
+#include "UringNet.h"
+#include "Coding.h"
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/**
+ * Constructor
+ *
+ * DESCRIPTION: Same as SocketNet; falls back to its epoll loop if no io_uring can be set up
+ */
+UringNet::UringNet(Params *p, int type, unsigned short basePort): SocketNet(p, type, basePort), ringFd(-1), sqes(NULL), cqes(NULL), sqRing(MAP_FAILED), cqRing(MAP_FAILED), bufferRing(NULL), buffers(NULL), inflight(0), stopping(false) {
+	inboxes.resize(SOCKET_MAX_NODES + 1);
+	if ( !setupRing() ) {
+		fprintf(stderr, "UringNet: no io_uring (%s), using epoll\n", strerror(errno));
+	}
+}
+
+/**
+ * Destructor
+ */
+UringNet::~UringNet() {
+	ENcleanup();
+}
+
+/**
+ * FUNCTION NAME: usesRing
+ *
+ * DESCRIPTION: Returns true if the sockets are driven by io_uring, false if by epoll
+ */
+bool UringNet::usesRing() {
+	return ringFd >= 0;
+}
+
+/**
+ * FUNCTION NAME: setupRing
+ *
+ * DESCRIPTION: Creates the ring, maps its queues and registers the receive buffers.
+ * 				IORING_SETUP_SINGLE_ISSUER came with multishot receive in Linux 6.0, so an
+ * 				older kernel refuses the setup and the epoll loop is used instead.
+ *
+ * RETURNS:
+ * true on SUCCESS
+ * false with errno set otherwise
+ */
+bool UringNet::setupRing() {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_CQSIZE;
+	params.cq_entries = URING_ENTRIES * URING_CQ_FACTOR;
+	ringFd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+	if ( ringFd < 0 ) {
+		return false;
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	void *entries = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if ( sqRing == MAP_FAILED || cqRing == MAP_FAILED || entries == MAP_FAILED ) {
+		int error = errno;
+		if ( entries != MAP_FAILED ) {
+			munmap(entries, sqesSize);
+		}
+		destroyRing();
+		errno = error;
+		return false;
+	}
+	sqes = (struct io_uring_sqe *) entries;
+
+	char *sq = (char *) sqRing;
+	char *cq = (char *) cqRing;
+	sqHead = (unsigned *)(sq + params.sq_off.head);
+	sqTail = (unsigned *)(sq + params.sq_off.tail);
+	sqFlags = (unsigned *)(sq + params.sq_off.flags);
+	sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+	sqEntries = params.sq_entries;
+	sqPrepared = *sqTail;
+	// entry i of the queue is always sqes[i]
+	unsigned *array = (unsigned *)(sq + params.sq_off.array);
+	for ( unsigned i = 0; i < sqEntries; i++ ) {
+		array[i] = i;
+	}
+	cqHead = (unsigned *)(cq + params.cq_off.head);
+	cqTail = (unsigned *)(cq + params.cq_off.tail);
+	cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	// each buffer holds the largest datagram
+	bufferSize = (par->MAX_MSG_SIZE + 4095) & ~4095;
+	void *ring = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ( ring == MAP_FAILED ) {
+		int error = errno;
+		destroyRing();
+		errno = error;
+		return false;
+	}
+	bufferRing = (struct io_uring_buf_ring *) ring;
+	buffers = (char *) malloc((size_t) URING_BUFFERS * bufferSize);
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) bufferRing;
+	reg.ring_entries = URING_BUFFERS;
+	reg.bgid = URING_BUFFER_GROUP;
+	if ( syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0 ) {
+		int error = errno;
+		destroyRing();
+		errno = error;
+		return false;
+	}
+	for ( unsigned id = 0; id < URING_BUFFERS; id++ ) {
+		giveBack((unsigned short) id);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: destroyRing
+ *
+ * DESCRIPTION: Unmaps and closes the ring, which the kernel then tears down, and frees the
+ * 				receive buffers. No request may be in flight.
+ */
+void UringNet::destroyRing() {
+	if ( sqes ) {
+		munmap(sqes, sqesSize);
+		sqes = NULL;
+	}
+	if ( sqRing != MAP_FAILED ) {
+		munmap(sqRing, sqRingSize);
+		sqRing = MAP_FAILED;
+	}
+	if ( cqRing != MAP_FAILED ) {
+		munmap(cqRing, cqRingSize);
+		cqRing = MAP_FAILED;
+	}
+	if ( ringFd >= 0 ) {
+		::close(ringFd);
+		ringFd = -1;
+	}
+	if ( bufferRing ) {
+		munmap(bufferRing, URING_BUFFERS * sizeof(struct io_uring_buf));
+		bufferRing = NULL;
+	}
+	free(buffers);
+	buffers = NULL;
+}
+
+/**
+ * FUNCTION NAME: giveBack
+ *
+ * DESCRIPTION: Hands receive buffer id back to the kernel
+ */
+void UringNet::giveBack(unsigned short id) {
+	unsigned short tail = bufferRing->tail;
+	// not bufferRing->bufs: in C++ the empty struct the kernel header puts before the
+	// flexible array takes a byte, which moves the array 8 bytes off
+	struct io_uring_buf *buffer = (struct io_uring_buf *) bufferRing + (tail & (URING_BUFFERS - 1));
+	// the fields only: the tail itself overlays the last ones of the first buffer
+	buffer->addr = (unsigned long)(buffers + (size_t) id * bufferSize);
+	buffer->len = bufferSize;
+	buffer->bid = id;
+	__atomic_store_n(&bufferRing->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * FUNCTION NAME: enter
+ *
+ * DESCRIPTION: io_uring_enter, retried when interrupted
+ */
+int UringNet::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+	int ret;
+	do {
+		ret = (int) syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+	} while ( ret < 0 && errno == EINTR );
+	return ret;
+}
+
+/**
+ * FUNCTION NAME: nextSqe
+ *
+ * DESCRIPTION: Returns a cleared submission queue entry, submitting the queue first if
+ * 				it is full
+ */
+struct io_uring_sqe *UringNet::nextSqe() {
+	while ( sqPrepared - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries ) {
+		submit();
+	}
+	struct io_uring_sqe *sqe = &sqes[sqPrepared & sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqPrepared++;
+	return sqe;
+}
+
+/**
+ * FUNCTION NAME: submit
+ *
+ * DESCRIPTION: Hands the entries prepared to the kernel with one system call. Sends to
+ * 				loopback complete within it, and so do the receives they wake up.
+ * 				Also makes the kernel flush completions it had to hold back because
+ * 				the completion queue was full.
+ */
+void UringNet::submit() {
+	unsigned toSubmit = sqPrepared - *sqTail;
+	unsigned flags = 0;
+	if ( __atomic_load_n(sqFlags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW ) {
+		flags |= IORING_ENTER_GETEVENTS;
+	}
+	if ( toSubmit == 0 && flags == 0 ) {
+		return;
+	}
+	__atomic_store_n(sqTail, sqPrepared, __ATOMIC_RELEASE);
+	for ( ;; ) {
+		int ret = enter(toSubmit, 0, flags);
+		if ( ret >= (int) toSubmit ) {
+			return;
+		}
+		if ( ret >= 0 ) {
+			toSubmit -= ret;
+			continue;
+		}
+		if ( errno != EBUSY && errno != EAGAIN ) {
+			fprintf(stderr, "UringNet: io_uring_enter: %s\n", strerror(errno));
+			return;
+		}
+		// too many completions pending: make room for those of the entries
+		reap();
+		flags |= IORING_ENTER_GETEVENTS;
+	}
+}
+
+/**
+ * FUNCTION NAME: reap
+ *
+ * DESCRIPTION: Handles every completion posted, without a system call
+ */
+void UringNet::reap() {
+	unsigned head = *cqHead;
+	while ( head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) ) {
+		// copied out so that the slot is free while the completion is handled
+		struct io_uring_cqe cqe = cqes[head & cqMask];
+		__atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+		complete(&cqe);
+	}
+}
+
+/**
+ * FUNCTION NAME: stash
+ *
+ * DESCRIPTION: Queue function keeping a message in the inbox of its node until its ENrecv
+ */
+int UringNet::stash(void *inbox, char *data, int size) {
+	((vector<pair<char *, int> > *) inbox)->push_back(make_pair(data, size));
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: arm
+ *
+ * DESCRIPTION: Submits the multishot accept of a listener, or the multishot receive into
+ * 				the registered buffers of a UDP socket or accepted connection
+ */
+void UringNet::arm(RingConnection *connection) {
+	struct io_uring_sqe *sqe = nextSqe();
+	sqe->fd = connection->fd;
+	if ( connection->kind == LISTENER ) {
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	}
+	else {
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = URING_BUFFER_GROUP;
+	}
+	sqe->user_data = (unsigned long) connection | RECEIVE;
+	connection->requests++;
+	inflight++;
+}
+
+/**
+ * FUNCTION NAME: sendQueued
+ *
+ * DESCRIPTION: Submits one send of what is left of the send in flight, or else of all the
+ * 				frames queued on an outbound connection, unless a send is in flight already
+ */
+void UringNet::sendQueued(RingConnection *connection) {
+	connection->queued = false;
+	if ( connection->closed || connection->writing || stopping ) {
+		return;
+	}
+	if ( connection->sending.empty() ) {
+		connection->sending.swap(connection->buffer);
+	}
+	if ( connection->sending.empty() ) {
+		return;
+	}
+	struct io_uring_sqe *sqe = nextSqe();
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = connection->fd;
+	sqe->addr = (unsigned long) connection->sending.data();
+	sqe->len = connection->sending.size();
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = (unsigned long) connection | SEND;
+	connection->writing = true;
+	connection->requests++;
+	inflight++;
+}
+
+/**
+ * FUNCTION NAME: release
+ *
+ * DESCRIPTION: Closes and frees a closed connection once the kernel holds no request on it
+ */
+void UringNet::release(RingConnection *connection) {
+	if ( connection->requests == 0 ) {
+		::close(connection->fd);
+		delete connection;
+	}
+}
+
+/**
+ * FUNCTION NAME: complete
+ *
+ * DESCRIPTION: Handles a completion: keeps what was received for its node, accepts a
+ * 				connection, counts as sent a datagram or the frames a send completes, or
+ * 				follows a partial send with the rest.
+ * 				A multishot request that ends, because the buffers ran out for instance, is
+ * 				submitted again; a connection ends at its end of file or on an error.
+ */
+void UringNet::complete(struct io_uring_cqe *cqe) {
+	if ( cqe->user_data == 0 ) {
+		// a cancellation
+		return;
+	}
+	RequestKind kind = (RequestKind)(cqe->user_data & REQUEST_KINDS);
+	bool last = !(cqe->flags & IORING_CQE_F_MORE);
+	if ( last ) {
+		inflight--;
+	}
+
+	if ( kind == DATAGRAM_SEND ) {
+		Datagram *datagram = (Datagram *)(cqe->user_data - kind);
+		RingConnection *connection = datagram->from;
+		if ( cqe->res == datagram->size ) {
+			connection->endpoint->sent++;
+		}
+		else {
+			connection->endpoint->dropped++;
+		}
+		free(datagram);
+		connection->requests--;
+		if ( connection->closed ) {
+			release(connection);
+		}
+		return;
+	}
+
+	RingConnection *connection = (RingConnection *)(cqe->user_data - kind);
+	Endpoint *endpoint = connection->endpoint;
+	if ( kind == SEND ) {
+		connection->writing = false;
+		connection->requests--;
+		if ( connection->closed ) {
+			release(connection);
+		}
+		else if ( cqe->res < 0 ) {
+			closeConnection(endpoint, connection);
+		}
+		else {
+			countWritten(endpoint, connection, cqe->res);
+			connection->sending.erase(0, cqe->res);
+			sendQueued(connection);
+		}
+		return;
+	}
+
+	bool valid = true;
+	if ( connection->kind == LISTENER ) {
+		if ( cqe->res >= 0 && (connection->closed || stopping) ) {
+			::close(cqe->res);
+		}
+		else if ( cqe->res >= 0 ) {
+			endpoint->inbound[cqe->res] = newConnection(endpoint, INBOUND, cqe->res, EPOLLIN);
+		}
+	}
+	else if ( cqe->flags & IORING_CQE_F_BUFFER ) {
+		unsigned short id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		char *data = buffers + (size_t) id * bufferSize;
+		vector<pair<char *, int> > *inbox = &inboxes[endpoint->id];
+		if ( cqe->res > 0 && !connection->closed && connection->kind == DATAGRAM ) {
+			deliver(endpoint, data, cqe->res, stash, inbox);
+		}
+		else if ( cqe->res > 0 && !connection->closed ) {
+			connection->buffer.append(data, cqe->res);
+			valid = deliverFrames(endpoint, connection, stash, inbox);
+		}
+		giveBack(id);
+	}
+
+	if ( last ) {
+		connection->requests--;
+	}
+	if ( connection->closed ) {
+		release(connection);
+	}
+	else if ( connection->kind == INBOUND && (!valid || (last && cqe->res <= 0 && cqe->res != -ENOBUFS)) ) {
+		closeConnection(endpoint, connection);
+	}
+	else if ( last && !stopping ) {
+		arm(connection);
+	}
+}
+
+/**
+ * FUNCTION NAME: newConnection
+ *
+ * DESCRIPTION: Wraps fd, and starts receiving, or accepting, on it unless it is an outbound
+ * 				connection, which is only written to
+ */
+SocketNet::Connection *UringNet::newConnection(Endpoint *endpoint, SocketKind kind, int fd, uint32_t events) {
+	if ( ringFd < 0 ) {
+		return SocketNet::newConnection(endpoint, kind, fd, events);
+	}
+	RingConnection *connection = new RingConnection();
+	connection->kind = kind;
+	connection->fd = fd;
+	connection->peer = 0;
+	connection->events = events;
+	connection->endpoint = endpoint;
+	connection->requests = 0;
+	connection->closed = connection->queued = connection->writing = false;
+	if ( kind != OUTBOUND ) {
+		arm(connection);
+	}
+	return connection;
+}
+
+/**
+ * FUNCTION NAME: closeConnection
+ *
+ * DESCRIPTION: Closes a TCP connection; the messages it had not written are lost. The
+ * 				requests on it are cancelled, and it is freed when the last one completes.
+ */
+void UringNet::closeConnection(Endpoint *endpoint, Connection *connection) {
+	if ( ringFd < 0 ) {
+		SocketNet::closeConnection(endpoint, connection);
+		return;
+	}
+	RingConnection *closing = (RingConnection *) connection;
+	// every frame not fully written, the send in flight included, is lost
+	endpoint->dropped += closing->unsent.size();
+	detach(endpoint, closing);
+	if ( closing->queued ) {
+		dirty.erase(find(dirty.begin(), dirty.end(), closing));
+	}
+	closing->closed = true;
+	if ( closing->requests > 0 ) {
+		// the descriptor stays open until then, so that the cancellation finds it
+		struct io_uring_sqe *sqe = nextSqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = closing->fd;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	}
+	release(closing);
+}
+
+/**
+ * FUNCTION NAME: ENsend
+ *
+ * DESCRIPTION: Prepares the sending of a message, which leaves with the next submission:
+ * 				a sendmsg of a copy of the datagram, or the frame is queued on the connection
+ * 				to the node, up to SOCKET_MAX_PENDING bytes.
+ * 				MSG_DROP_PROB drops messages as in EmulNet.
+ *
+ * RETURNS:
+ * size, 0 if the message was dropped
+ */
+int UringNet::ENsend(Address *myaddr, Address *toaddr, char *data, int size) {
+	if ( ringFd < 0 ) {
+		return SocketNet::ENsend(myaddr, toaddr, data, size);
+	}
+	if ( lost(size) ) {
+		return 0;
+	}
+
+	Endpoint *endpoint = endpointOf(*(int *)(myaddr->addr));
+	int dst = *(int *)(toaddr->addr);
+	assert(dst > 0 && dst <= SOCKET_MAX_NODES);
+
+	if ( type == SOCK_DGRAM ) {
+		if ( endpoint->socket == NULL ) {
+			endpoint->dropped++;
+			return 0;
+		}
+		Datagram *datagram = (Datagram *) malloc(sizeof(Datagram) + size);
+		datagram->from = (RingConnection *) endpoint->socket;
+		datagram->size = size;
+		datagram->data = (char *)(datagram + 1);
+		memcpy(datagram->data, data, size);
+		datagram->to = loopback(basePort + dst);
+		datagram->part.iov_base = datagram->data;
+		datagram->part.iov_len = size;
+		memset(&datagram->header, 0, sizeof(datagram->header));
+		datagram->header.msg_name = &datagram->to;
+		datagram->header.msg_namelen = sizeof(datagram->to);
+		datagram->header.msg_iov = &datagram->part;
+		datagram->header.msg_iovlen = 1;
+
+		struct io_uring_sqe *sqe = nextSqe();
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = datagram->from->fd;
+		sqe->addr = (unsigned long) &datagram->header;
+		sqe->len = 1;
+		sqe->user_data = (unsigned long) datagram | DATAGRAM_SEND;
+		datagram->from->requests++;
+		inflight++;
+		return size;
+	}
+
+	RingConnection *connection = (RingConnection *) connectTo(endpoint, dst);
+	if ( connection == NULL || connection->buffer.size() + connection->sending.size() + SOCKET_FRAME_HEADER + size > SOCKET_MAX_PENDING ) {
+		endpoint->dropped++;
+		return 0;
+	}
+	char header[SOCKET_FRAME_HEADER];
+	encodeU32(header, (uint32_t)size);
+	connection->buffer.append(header, SOCKET_FRAME_HEADER);
+	connection->buffer.append(data, size);
+	connection->unsent.push_back(SOCKET_FRAME_HEADER + size);
+	if ( !connection->queued && !connection->writing ) {
+		connection->queued = true;
+		dirty.push_back(connection);
+	}
+	return size;
+}
+
+/**
+ * FUNCTION NAME: ENrecv
+ *
+ * DESCRIPTION: Submits all that was prepared since the last call, of every node, reaps the
+ * 				completions, and hands the node the messages kept for it
+ *
+ * RETURN:
+ * 0
+ */
+int UringNet::ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue) {
+	if ( ringFd < 0 ) {
+		return SocketNet::ENrecv(myaddr, enq, t, times, queue);
+	}
+	Endpoint *endpoint = endpointOf(*(int *)(myaddr->addr));
+
+	for ( RingConnection *connection : dirty ) {
+		sendQueued(connection);
+	}
+	dirty.clear();
+	submit();
+	reap();
+
+	vector<pair<char *, int> > &inbox = inboxes[endpoint->id];
+	for ( auto &message : inbox ) {
+		(*enq)(queue, message.first, message.second);
+	}
+	inbox.clear();
+	return 0;
+}
+
+/**
+ * FUNCTION NAME: ENcleanup
+ *
+ * DESCRIPTION: Cancels every request and waits for them, so that the kernel no longer
+ * 				uses any buffer, destroys the ring, then closes the sockets and writes
+ * 				msgcount.log as SocketNet does. Messages never handed to a node are freed.
+ */
+int UringNet::ENcleanup() {
+	if ( ringFd >= 0 ) {
+		stopping = true;
+		for ( RingConnection *connection : dirty ) {
+			connection->queued = false;
+		}
+		dirty.clear();
+		struct io_uring_sqe *sqe = nextSqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+		submit();
+		while ( inflight > 0 ) {
+			reap();
+			if ( inflight > 0 && enter(0, 1, IORING_ENTER_GETEVENTS) < 0 ) {
+				break;
+			}
+		}
+		destroyRing();
+	}
+	for ( auto &inbox : inboxes ) {
+		for ( auto &message : inbox ) {
+			free(message.first);
+		}
+		inbox.clear();
+	}
+	return SocketNet::ENcleanup();
+}
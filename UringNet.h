@@ -0,0 +1,115 @@
+/**********************************
+ * FILE NAME: UringNet.h
+ *
+ * DESCRIPTION: Header file of the transport over loopback sockets driven by io_uring
+ **********************************/
+
+#ifndef _URINGNET_H_
+#define _URINGNET_H_
+
+#include "SocketNet.h"
+#include <linux/io_uring.h>
+
+// submission queue entries; the completion queue is URING_CQ_FACTOR times larger
+#define URING_ENTRIES 1024
+#define URING_CQ_FACTOR 4
+// receive buffers the kernel picks from, a power of two
+#define URING_BUFFERS 1024
+// group id of the receive buffers
+#define URING_BUFFER_GROUP 0
+
+/**
+ * CLASS NAME: UringNet
+ *
+ * DESCRIPTION: SocketNet whose socket I/O goes through one io_uring shared by the nodes
+ * 				of the network instead of a system call per message:
+ * 				- every UDP socket, accepted connection and listener has one multishot
+ * 				  request that keeps receiving, or accepting, until cancelled. Received
+ * 				  bytes land in a ring of buffers registered with the kernel, which are
+ * 				  copied into the messages of the node and given back at once.
+ * 				- ENsend only prepares requests: a sendmsg per datagram, or, for TCP, the
+ * 				  frames are appended to the connection and all those queued on it go out
+ * 				  with one send when the ring is next submitted.
+ * 				- ENrecv submits everything prepared since the last call with a single
+ * 				  io_uring_enter, then reaps the completions without a system call,
+ * 				  keeping the messages of the other nodes until their own ENrecv.
+ * 				So the nodes of a tick share one system call, whatever their fan-out.
+ * 				Without io_uring (a kernel older than 6.0, or io_uring disabled) it falls
+ * 				back to the epoll loop of SocketNet.
+ */
+class UringNet : public SocketNet {
+private:
+	// the low bits of the user_data of a request tell what it is
+	enum RequestKind { RECEIVE, SEND, DATAGRAM_SEND, REQUEST_KINDS = 3 };
+	class RingConnection : public Connection {
+	public:
+		Endpoint *endpoint;
+		// requests the kernel holds on the connection: it is freed once they are done
+		int requests;
+		bool closed;
+		// waiting in the dirty list to be sent
+		bool queued;
+		// a send is in flight, of the bytes in sending; new frames wait in buffer
+		bool writing;
+		string sending;
+	};
+	class Datagram {
+	public:
+		RingConnection *from;
+		struct msghdr header;
+		struct iovec part;
+		struct sockaddr_in to;
+		int size;
+		// the copy of the message, allocated right after the Datagram
+		char *data;
+	};
+	int ringFd;
+	// submission queue, mapped from the kernel
+	unsigned *sqHead, *sqTail, *sqFlags;
+	unsigned sqMask, sqEntries;
+	// tail of the entries prepared, ahead of *sqTail until they are submitted
+	unsigned sqPrepared;
+	struct io_uring_sqe *sqes;
+	// completion queue, mapped from the kernel
+	unsigned *cqHead, *cqTail;
+	unsigned cqMask;
+	struct io_uring_cqe *cqes;
+	void *sqRing, *cqRing;
+	size_t sqRingSize, cqRingSize, sqesSize;
+	// receive buffers registered with the kernel
+	struct io_uring_buf_ring *bufferRing;
+	char *buffers;
+	unsigned bufferSize;
+	// requests submitted and not completed yet
+	unsigned long inflight;
+	bool stopping;
+	// outbound connections with frames to send
+	vector<RingConnection *> dirty;
+	// messages received for each node and not handed to its queue yet
+	vector<vector<pair<char *, int> > > inboxes;
+	bool setupRing();
+	void destroyRing();
+	struct io_uring_sqe *nextSqe();
+	int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+	void submit();
+	void reap();
+	void complete(struct io_uring_cqe *cqe);
+	void arm(RingConnection *connection);
+	void sendQueued(RingConnection *connection);
+	void giveBack(unsigned short id);
+	void release(RingConnection *connection);
+	static int stash(void *inbox, char *data, int size);
+protected:
+	Connection *newConnection(Endpoint *endpoint, SocketKind kind, int fd, uint32_t events);
+	void closeConnection(Endpoint *endpoint, Connection *connection);
+public:
+	UringNet(Params *p, int type, unsigned short basePort);
+	virtual ~UringNet();
+	int ENsend(Address *myaddr, Address *toaddr, char *data, int size);
+	int ENrecv(Address *myaddr, int (* enq)(void *, char *, int), struct timeval *t, int times, void *queue);
+	int ENcleanup();
+	// true if io_uring is used, false if it fell back to epoll
+	bool usesRing();
+};
+
+#endif /* _URINGNET_H_ */
@@ -0,0 +1,445 @@
+/**********************************
+ * FILE NAME: ValueLogEngine.cpp
+ *
+ * DESCRIPTION: Definition of the key-value separating backend
+ **********************************/
+
+#include "ValueLogEngine.h"
+#include "Coding.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+/**
+ * Constructor
+ */
+ValueLogEngine::ValueLogEngine(StorageEngine *index, string dir, unsigned long threshold): index(index), dir(dir), threshold(threshold) {
+	logBytes = 0;
+	garbageBytes = 0;
+	gcCursor = 0;
+	load();
+	index->setFlushHook([this]() { return syncLog(); });
+}
+
+/**
+ * Destructor
+ */
+ValueLogEngine::~ValueLogEngine() {
+	delete index;
+	for ( auto &segment : segments ) {
+		close(segment.second.fd);
+	}
+}
+
+/**
+ * FUNCTION NAME: segmentPath
+ *
+ * DESCRIPTION: Returns the file name of a segment
+ */
+string ValueLogEngine::segmentPath(uint32_t id) {
+	return dir + "/vlog_" + to_string(id) + ".log";
+}
+
+/**
+ * FUNCTION NAME: load
+ *
+ * DESCRIPTION: Opens the segments left in dir by a previous run. With an empty index
+ * 				nothing can point into them (in-memory indexes always start empty), so
+ * 				they are deleted instead.
+ */
+void ValueLogEngine::load() {
+	mkdir(dir.c_str(), 0755);
+	DIR *d = opendir(dir.c_str());
+	if ( d == NULL ) {
+		return;
+	}
+	vector<uint32_t> ids;
+	struct dirent *e;
+	while ( (e = readdir(d)) != NULL ) {
+		unsigned int id;
+		int length = 0;
+		if ( sscanf(e->d_name, "vlog_%u.log%n", &id, &length) == 1 && length == (int)strlen(e->d_name) ) {
+			ids.push_back(id);
+		}
+	}
+	closedir(d);
+
+	bool empty = index->size() == 0;
+	for ( unsigned int i = 0; i < ids.size(); i++ ) {
+		if ( empty ) {
+			unlink(segmentPath(ids[i]).c_str());
+			continue;
+		}
+		struct stat st;
+		int fd = ::open(segmentPath(ids[i]).c_str(), O_RDWR);
+		if ( fd < 0 || fstat(fd, &st) != 0 ) {
+			if ( fd >= 0 ) {
+				close(fd);
+			}
+			continue;
+		}
+		Segment segment;
+		segment.fd = fd;
+		segment.size = st.st_size;
+		segment.garbage = 0;
+		segments[ids[i]] = segment;
+		logBytes += segment.size;
+	}
+
+	// the last segment may end with a torn entry, so appends go to a new one
+	if ( !segments.empty() ) {
+		roll();
+	}
+}
+
+/**
+ * FUNCTION NAME: roll
+ *
+ * DESCRIPTION: Syncs the segment being appended to and starts a new one
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int ValueLogEngine::roll() {
+	if ( syncLog() == FAILURE ) {
+		return FAILURE;
+	}
+	uint32_t id = segments.empty() ? 1 : segments.rbegin()->first + 1;
+	int fd = ::open(segmentPath(id).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if ( fd < 0 ) {
+		return FAILURE;
+	}
+	Segment segment;
+	segment.fd = fd;
+	segment.size = 0;
+	segment.garbage = 0;
+	segments[id] = segment;
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: syncLog
+ *
+ * DESCRIPTION: Makes the segment being appended to durable; the older ones were
+ * 				synced when it was started
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int ValueLogEngine::syncLog() {
+	if ( !segments.empty() && fdatasync(segments.rbegin()->second.fd) != 0 ) {
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+/**
+ * FUNCTION NAME: append
+ *
+ * DESCRIPTION: Appends a (key,value) entry to the log and sets *pointer to the index
+ * 				value locating it
+ *
+ * RETURNS:
+ * true on SUCCESS
+ * false on FAILURE
+ */
+bool ValueLogEngine::append(string_view key, string_view value, string *pointer) {
+	if ( segments.empty() || segments.rbegin()->second.size >= VLOG_SEGMENT_SIZE ) {
+		if ( roll() == FAILURE ) {
+			return false;
+		}
+	}
+	uint32_t id = segments.rbegin()->first;
+	Segment &segment = segments.rbegin()->second;
+
+	string entry;
+	entry.reserve(VLOG_ENTRY_HEADER + key.size() + value.size());
+	putU32(entry, (uint32_t)key.size());
+	putU32(entry, (uint32_t)value.size());
+	entry.append(key.data(), key.size());
+	entry.append(value.data(), value.size());
+	if ( pwrite(segment.fd, entry.data(), entry.size(), segment.size) != (ssize_t)entry.size() ) {
+		return false;
+	}
+
+	pointer->clear();
+	pointer->push_back((char)VLOG_POINTER);
+	putU32(*pointer, id);
+	putU64(*pointer, segment.size + VLOG_ENTRY_HEADER + key.size());
+	putU32(*pointer, (uint32_t)value.size());
+	segment.size += entry.size();
+	logBytes += entry.size();
+	return true;
+}
+
+/**
+ * FUNCTION NAME: resolve
+ *
+ * DESCRIPTION: Sets *value to the value an index entry stands for. An inlined value
+ * 				points into stored, a logged one is read into *buffer.
+ *
+ * RETURNS:
+ * true on SUCCESS
+ * false if the entry is malformed or its segment cannot be read
+ */
+bool ValueLogEngine::resolve(string_view stored, string *buffer, string_view *value) {
+	if ( !stored.empty() && stored[0] == VLOG_INLINE ) {
+		*value = stored.substr(1);
+		return true;
+	}
+	if ( stored.size() != VLOG_POINTER_SIZE || stored[0] != VLOG_POINTER ) {
+		return false;
+	}
+	auto it = segments.find(getU32(stored.data() + 1));
+	if ( it == segments.end() ) {
+		return false;
+	}
+	uint64_t offset = getU64(stored.data() + 5);
+	uint32_t length = getU32(stored.data() + 13);
+	buffer->resize(length);
+	if ( length > 0 && pread(it->second.fd, &(*buffer)[0], length, offset) != (ssize_t)length ) {
+		return false;
+	}
+	*value = *buffer;
+	return true;
+}
+
+/**
+ * FUNCTION NAME: discard
+ *
+ * DESCRIPTION: Counts the log entry of a replaced or erased index entry as garbage
+ */
+void ValueLogEngine::discard(string_view key, string_view stored) {
+	if ( stored.size() != VLOG_POINTER_SIZE || stored[0] != VLOG_POINTER ) {
+		return;
+	}
+	auto it = segments.find(getU32(stored.data() + 1));
+	if ( it == segments.end() ) {
+		return;
+	}
+	uint64_t bytes = VLOG_ENTRY_HEADER + key.size() + getU32(stored.data() + 13);
+	it->second.garbage += bytes;
+	garbageBytes += bytes;
+}
+
+/**
+ * FUNCTION NAME: needsCollection
+ *
+ * DESCRIPTION: Returns true while enough of the log is garbage to be worth collecting
+ */
+bool ValueLogEngine::needsCollection() {
+	return garbageBytes >= VLOG_GC_MIN && garbageBytes > logBytes * VLOG_GC_RATIO;
+}
+
+/**
+ * FUNCTION NAME: collect
+ *
+ * DESCRIPTION: One step of the log garbage collection: walks VLOG_GC_BATCH entries of
+ * 				the oldest segment and appends the ones the index still points at to the
+ * 				end of the log. Once the whole segment is walked, the index is synced so
+ * 				no durable entry points into it anymore, and the segment is deleted.
+ */
+void ValueLogEngine::collect() {
+	// the oldest segment must not be the one appended to
+	if ( segments.size() == 1 && roll() == FAILURE ) {
+		return;
+	}
+	uint32_t victimId = segments.begin()->first;
+	Segment &victim = segments.begin()->second;
+	string header(VLOG_ENTRY_HEADER, '\0'), entry, pointer;
+
+	for ( int n = 0; n < VLOG_GC_BATCH && gcCursor < victim.size; n++ ) {
+		if ( gcCursor + VLOG_ENTRY_HEADER > victim.size ) {
+			// torn tail
+			gcCursor = victim.size;
+			break;
+		}
+		if ( pread(victim.fd, &header[0], VLOG_ENTRY_HEADER, gcCursor) != VLOG_ENTRY_HEADER ) {
+			return;
+		}
+		uint64_t keySize = getU32(header.data()), valueSize = getU32(header.data() + 4);
+		if ( gcCursor + VLOG_ENTRY_HEADER + keySize + valueSize > victim.size ) {
+			gcCursor = victim.size;
+			break;
+		}
+		entry.resize(keySize + valueSize);
+		if ( !entry.empty() && pread(victim.fd, &entry[0], entry.size(), gcCursor + VLOG_ENTRY_HEADER) != (ssize_t)entry.size() ) {
+			return;
+		}
+
+		string_view key(entry.data(), keySize), value(entry.data() + keySize, valueSize);
+		uint64_t valueOffset = gcCursor + VLOG_ENTRY_HEADER + keySize;
+		bool failed = false;
+		index->mutate(key, [&](const string_view *stored, string_view *replacement) {
+			// the entry is live only if the index still points at it
+			if ( stored == NULL || stored->size() != VLOG_POINTER_SIZE || (*stored)[0] != VLOG_POINTER ||
+					getU32(stored->data() + 1) != victimId || getU64(stored->data() + 5) != valueOffset ) {
+				return KEEP_VALUE;
+			}
+			if ( !append(key, value, &pointer) ) {
+				failed = true;
+				return KEEP_VALUE;
+			}
+			*replacement = pointer;
+			return STORE_VALUE;
+		});
+		if ( failed ) {
+			return;
+		}
+		gcCursor += VLOG_ENTRY_HEADER + entry.size();
+	}
+
+	if ( gcCursor < victim.size || sync() == FAILURE ) {
+		return;
+	}
+	close(victim.fd);
+	unlink(segmentPath(victimId).c_str());
+	logBytes -= victim.size;
+	garbageBytes -= victim.garbage;
+	segments.erase(segments.begin());
+	gcCursor = 0;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Looks the key up in the index, then reads a logged value from its segment
+ */
+bool ValueLogEngine::find(string_view key, string *value) {
+	string stored, buffer;
+	string_view resolved;
+	if ( value == NULL ) {
+		return index->find(key, NULL);
+	}
+	if ( !index->find(key, &stored) || !resolve(stored, &buffer, &resolved) ) {
+		return false;
+	}
+	value->assign(resolved.data(), resolved.size());
+	return true;
+}
+
+/**
+ * FUNCTION NAME: mayContain
+ *
+ * DESCRIPTION: Asks the index
+ */
+bool ValueLogEngine::mayContain(string_view key) {
+	return index->mayContain(key);
+}
+
+/**
+ * FUNCTION NAME: mutate
+ *
+ * DESCRIPTION: Hands decide the actual value of the key and stores what it asks for,
+ * 				logging the new value if it is large. Afterwards runs a step of the log
+ * 				garbage collection if needed.
+ */
+void ValueLogEngine::mutate(string_view key, const Mutator &decide) {
+	string buffer, encoded;
+
+	index->mutate(key, [&](const string_view *stored, string_view *replacement) {
+		string_view current, value;
+		bool present = stored != NULL && resolve(*stored, &buffer, &current);
+		MutateAction action = decide(present ? &current : NULL, &value);
+		if ( action == KEEP_VALUE ) {
+			return KEEP_VALUE;
+		}
+		if ( stored != NULL ) {
+			discard(key, *stored);
+		}
+		if ( action == ERASE_VALUE ) {
+			return ERASE_VALUE;
+		}
+		if ( value.size() < threshold || !append(key, value, &encoded) ) {
+			// small values, and values the log could not take, stay in the index
+			encoded.clear();
+			encoded.push_back((char)VLOG_INLINE);
+			encoded.append(value.data(), value.size());
+		}
+		*replacement = encoded;
+		return STORE_VALUE;
+	});
+
+	if ( needsCollection() ) {
+		collect();
+	}
+}
+
+/**
+ * FUNCTION NAME: size
+ *
+ * DESCRIPTION: Returns the number of keys
+ */
+unsigned long ValueLogEngine::size() {
+	return index->size();
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Empties the index and deletes every segment
+ */
+void ValueLogEngine::clear() {
+	index->clear();
+	for ( auto &segment : segments ) {
+		close(segment.second.fd);
+		unlink(segmentPath(segment.first).c_str());
+	}
+	segments.clear();
+	logBytes = 0;
+	garbageBytes = 0;
+	gcCursor = 0;
+}
+
+/**
+ * FUNCTION NAME: scan
+ *
+ * DESCRIPTION: Visits every pair in the order of the index
+ */
+void ValueLogEngine::scan(const function<void(string_view, string_view)> &visit) {
+	string buffer;
+	index->scan([&](string_view key, string_view stored) {
+		string_view value;
+		if ( resolve(stored, &buffer, &value) ) {
+			visit(key, value);
+		}
+	});
+}
+
+/**
+ * FUNCTION NAME: scanRange
+ *
+ * DESCRIPTION: Visits the pairs of a token range, as the index finds them
+ */
+void ValueLogEngine::scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit) {
+	string buffer;
+	index->scanRange(first, last, [&](string_view key, string_view stored) {
+		string_view value;
+		if ( resolve(stored, &buffer, &value) ) {
+			visit(key, value);
+		}
+	});
+}
+
+/**
+ * FUNCTION NAME: sync
+ *
+ * DESCRIPTION: Makes the log, then the index, durable
+ *
+ * RETURNS:
+ * SUCCESS or FAILURE
+ */
+int ValueLogEngine::sync() {
+	if ( syncLog() == FAILURE ) {
+		return FAILURE;
+	}
+	return index->sync();
+}
+
+/**
+ * FUNCTION NAME: getStats
+ *
+ * DESCRIPTION: Returns the memory held by the index; logged values are on disk
+ */
+ArenaStats ValueLogEngine::getStats() {
+	return index->getStats();
+}
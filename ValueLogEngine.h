@@ -0,0 +1,88 @@
+/**********************************
+ * FILE NAME: ValueLogEngine.h
+ *
+ * DESCRIPTION: Header file of the key-value separating backend
+ **********************************/
+
+#ifndef VALUELOGENGINE_H_
+#define VALUELOGENGINE_H_
+
+/**
+ * Header files
+ */
+#include "StorageEngine.h"
+
+/*
+ * Macros
+ */
+// first byte of the values stored in the index
+#define VLOG_INLINE 0
+#define VLOG_POINTER 1
+// [u8 VLOG_POINTER][u32 segment][u64 offset][u32 length]
+#define VLOG_POINTER_SIZE 17
+// a log entry is [u32 key size][u32 value size][key][value]
+#define VLOG_ENTRY_HEADER 8
+// a new segment is started once the current one holds this many bytes
+#define VLOG_SEGMENT_SIZE (64 << 20)
+// the log is collected once this share of its bytes, and at least VLOG_GC_MIN, is garbage
+#define VLOG_GC_RATIO 0.5
+#define VLOG_GC_MIN (1 << 20)
+// log entries examined by the collection after each write
+#define VLOG_GC_BATCH 32
+
+/**
+ * CLASS NAME: ValueLogEngine
+ *
+ * DESCRIPTION: Key-value separation (as in WiscKey) on top of another engine, the index.
+ * 				Values of threshold bytes or more are appended to a value log of segment
+ * 				files dir/vlog_<id>.log and the index only holds their location, so index
+ * 				operations and compactions move a few bytes whatever the value size.
+ * 				A read costs one extra pread for such a value.
+ * 				Replaced values are counted as garbage; once there is enough, each write
+ * 				also relocates a few live entries out of the oldest segment, which is
+ * 				deleted when done.
+ * 				The log is synced before the index writes anything to disk, so a durable
+ * 				index entry never points at log bytes a crash could lose.
+ * 				Owns the index engine.
+ */
+class ValueLogEngine : public StorageEngine {
+private:
+	class Segment {
+	public:
+		int fd;
+		uint64_t size;
+		uint64_t garbage;
+	};
+	StorageEngine *index;
+	string dir;
+	unsigned long threshold;
+	// oldest first; values are appended to the last one
+	map<uint32_t, Segment> segments;
+	uint64_t logBytes;
+	uint64_t garbageBytes;
+	// next entry of the oldest segment to relocate
+	uint64_t gcCursor;
+	string segmentPath(uint32_t id);
+	void load();
+	int roll();
+	int syncLog();
+	bool append(string_view key, string_view value, string *pointer);
+	bool resolve(string_view stored, string *buffer, string_view *value);
+	void discard(string_view key, string_view stored);
+	bool needsCollection();
+	void collect();
+public:
+	ValueLogEngine(StorageEngine *index, string dir, unsigned long threshold);
+	bool find(string_view key, string *value);
+	bool mayContain(string_view key);
+	void mutate(string_view key, const Mutator &decide);
+	unsigned long size();
+	void clear();
+	void scan(const function<void(string_view, string_view)> &visit);
+	void scanRange(size_t first, size_t last, const function<void(string_view, string_view)> &visit);
+	int sync();
+	ArenaStats getStats();
+	virtual ~ValueLogEngine();
+};
+
+#endif /* VALUELOGENGINE_H_ */
@@ -0,0 +1,77 @@
+/**********************************
+ * FILE NAME: WorkerPool.cpp
+ *
+ * DESCRIPTION: Definition of the fixed pool of worker threads of a node
+ **********************************/
+
+#include "WorkerPool.h"
+
+/**
+ * Constructor
+ */
+WorkerPool::WorkerPool(int size): generation(0), pending(0), stopping(false) {
+	for ( int i = 0; i < size; i++ ) {
+		threads.emplace_back(&WorkerPool::work, this, i);
+	}
+}
+
+/**
+ * Destructor
+ */
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for ( unsigned int i = 0; i < threads.size(); i++ ) {
+		threads[i].join();
+	}
+}
+
+/**
+ * FUNCTION NAME: size
+ *
+ * DESCRIPTION: Returns the number of workers
+ */
+int WorkerPool::size() {
+	return (int)threads.size();
+}
+
+/**
+ * FUNCTION NAME: run
+ *
+ * DESCRIPTION: Calls task(worker) on every worker and waits for all of them
+ */
+void WorkerPool::run(const function<void(int)> &task) {
+	unique_lock<mutex> guard(lock);
+	this->task = task;
+	pending = (int)threads.size();
+	generation++;
+	wake.notify_all();
+	done.wait(guard, [this] { return pending == 0; });
+	this->task = nullptr;
+}
+
+/**
+ * FUNCTION NAME: work
+ *
+ * DESCRIPTION: Body of a worker thread: waits for a new generation, runs its share
+ */
+void WorkerPool::work(int worker) {
+	unsigned long seen = 0;
+	unique_lock<mutex> guard(lock);
+	while ( true ) {
+		wake.wait(guard, [&] { return stopping || generation != seen; });
+		if ( stopping ) {
+			return;
+		}
+		seen = generation;
+		guard.unlock();
+		task(worker);
+		guard.lock();
+		if ( --pending == 0 ) {
+			done.notify_one();
+		}
+	}
+}
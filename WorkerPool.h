@@ -0,0 +1,45 @@
+/**********************************
+ * FILE NAME: WorkerPool.h
+ *
+ * DESCRIPTION: Header file of the fixed pool of worker threads of a node
+ **********************************/
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * CLASS NAME: WorkerPool
+ *
+ * DESCRIPTION: Threads started once and reused for every batch of work.
+ * 				run() hands the same task to every worker, each called with its
+ * 				own index, and returns when all of them are done (fork-join).
+ */
+class WorkerPool {
+private:
+	vector<thread> threads;
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+	function<void(int)> task;
+	// bumped by every run() so each worker picks a task up exactly once
+	unsigned long generation;
+	int pending;
+	bool stopping;
+	void work(int worker);
+public:
+	WorkerPool(int size);
+	int size();
+	void run(const function<void(int)> &task);
+	virtual ~WorkerPool();
+};
+
+#endif /* WORKERPOOL_H_ */